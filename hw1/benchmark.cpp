@@ -0,0 +1,83 @@
+// Measures the impact of the thread placement policies of COptimizer::start on the sample workload, or on
+// traces recorded by CRecordingCompany (one replayed company per trace, speed 0 = no delays).
+//   ./benchmark <policy> [-t threadCount] [-c companies] [-s speed] [trace ...]   (see the bench target in the Makefile)
+// -c sets the number of sample companies (default 2), each delivers all the sample polygons once. The progtest solver
+// library caps the number of problems solved per process, thus every policy runs in its own process and a workload
+// beyond the 2 sample companies is solved natively (COptimizer::useNativeSolvers).
+// Built with -DOPTIMIZER_TRACE, the run also writes the pipeline events to optimizer_trace.json (Chrome trace format).
+#include "trace_company.h"
+
+#define SOLUTION_NO_MAIN
+#include "solution.cpp"
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static const map<string, CPlacementPolicy> g_Policies =
+{
+    {"none",     {false, false, false}},
+    {"pinned",   {true,  false, false}},
+    {"colocate", {false, true,  false}},
+    {"isolated", {true,  false, true }},
+    {"all",      {true,  true,  true }},
+};
+
+static constexpr int LIBRARY_COMPANIES = 2;     // the sample companies the progtest library budget covers
+
+
+int main(int argc, char * argv[])
+{
+    int threadCount = (int)max(1u, thread::hardware_concurrency());
+    int companies = LIBRARY_COMPANIES;
+    double speed = 1;
+    bool valid = true;
+    int opt;
+    while((opt = getopt(argc, argv, "t:c:s:")) != -1){
+        switch(opt){
+            case 't': threadCount = max(1, atoi(optarg)); break;
+            case 'c': companies = max(0, atoi(optarg)); break;
+            case 's': speed = atof(optarg); break;
+            default: valid = false;
+        }
+    }
+    if(!valid || optind >= argc || !g_Policies.count(argv[optind])){
+        cerr << "usage: " << argv[0] << " <none|pinned|colocate|isolated|all> [-t threadCount] [-c companies] [-s speed] [trace ...]" << endl;
+        return 1;
+    }
+    string policy = argv[optind];
+
+    COptimizer optimizer;
+    vector<function<bool()>> processed;
+
+    vector<AReplayCompany> replayed;
+    for(int i = optind + 1; i < argc; ++i){
+        AReplayCompany company = std::make_shared<CReplayCompany>(argv[i], speed);
+        optimizer.addCompany(company);
+        processed.emplace_back([company] { return company->allProcessed(); });
+        replayed.push_back(company);
+    }
+    bool traces = optind + 1 < argc;
+    for(int i = 0; !traces && i < companies; ++i){
+        ACompanyTest company = std::make_shared<CCompanyTest>();
+        optimizer.addCompany(company);
+        processed.emplace_back([company] { return company->allProcessed(); });
+    }
+    optimizer.useNativeSolvers(!traces && companies > LIBRARY_COMPANIES);
+    optimizer.useSolverBudget(COptimizer::DELIVERED_BUDGET);
+
+    auto begin = chrono::steady_clock::now();
+    optimizer.start(threadCount, g_Policies.at(policy));
+    optimizer.stop();
+    auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - begin);
+#ifdef OPTIMIZER_TRACE
+    CTraceLog::dump("optimizer_trace.json");
+#endif /* OPTIMIZER_TRACE */
+
+    if(!all_of(processed.begin(), processed.end(), [](auto & done) { return done(); }))
+        throw std::logic_error("(some) problems were not correctly processsed");
+    for(size_t i = 0; i < replayed.size(); ++i)
+        if(replayed[i]->truncated()) cerr << "warning: " << argv[optind + 1 + i] << " is truncated, replayed up to the cut" << endl;
+
+    cout << setw(10) << policy << setw(4) << threadCount << " threads " << setw(5) << processed.size() << " companies "
+         << fixed << setprecision(3) << elapsed.count() << " ms" << endl;
+    return 0;
+}
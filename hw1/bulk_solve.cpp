@@ -0,0 +1,237 @@
+// Offline bulk solver. Drives COptimizer over a memory-mapped polygon archive and streams the results
+// to a text file, one line per polygon in the archive order. The batches are solved natively, the progtest
+// library caps a process at about 100 problems. -l uses its solvers within that budget. -M memoizes up to entries
+// sub-chains per kind across the polygons, see COptimizer::useChainMemo. -a approximates the TriangMin results
+// by CApproxTriangulation (CCompanyConfig::m_ApproxMin).
+//
+//   ./bulk_solve [-t threads] [-m min|cnt|both] [-b batchMs] [-s store] [-p processes] [-l] [-M entries] [-a] archive output
+//   ./bulk_solve -c polygons.txt archive       (converts text, one polygon per line: x0 y0 x1 y1 ...)
+//
+// Archive layout (native byte order):
+//   char magic[4] = "PGAR", uint32_t version, uint64_t count,
+//   uint64_t offsets[count + 1] (index of the first point of each polygon, the last entry is the total),
+//   int32_t coords[2 * total] (x0, y0, x1, y1, ...)
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SOLUTION_NO_MAIN
+#include "solution.cpp"
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static constexpr char ARCHIVE_MAGIC[4] = {'P', 'G', 'A', 'R'};
+static constexpr uint32_t ARCHIVE_VERSION = 1;
+static constexpr size_t PACK_SIZE = 64;
+
+struct ArchiveHeader
+{
+    char m_Magic[4];
+    uint32_t m_Version;
+    uint64_t m_Count;
+};
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Delivers the archive in packs of PACK_SIZE polygons. The polygons of a pack live in one arena, the APolygons
+ * only alias it, so there is a single allocation and control block per pack instead of one per polygon.
+ */
+class CArchiveCompany : public CCompany
+{
+public:
+    CArchiveCompany(const string & archive, const string & output, bool min, bool cnt);
+    ~CArchiveCompany() noexcept override;
+
+    AProblemPack waitForPack() override;
+    void solvedPack(AProblemPack pack) override;
+
+private:
+    const uint8_t * m_Data = nullptr;
+    size_t m_Size = 0;
+    const uint64_t * m_Offsets = nullptr;
+    const int32_t * m_Coords = nullptr;
+    size_t m_Count = 0;
+    size_t m_Next = 0;
+
+    bool m_Min, m_Cnt;
+    FILE * m_Out;
+};
+
+
+CArchiveCompany::CArchiveCompany(const string & archive, const string & output, bool min, bool cnt) : m_Min(min), m_Cnt(cnt)
+{
+    int fd = open(archive.c_str(), O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) || (size_t)st.st_size < sizeof(ArchiveHeader)){
+        if(fd >= 0) close(fd);
+        throw runtime_error("cannot open archive " + archive);
+    }
+
+    void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) throw runtime_error("cannot map archive " + archive);
+    m_Data = (const uint8_t*)data;
+    m_Size = st.st_size;
+    madvise(data, m_Size, MADV_SEQUENTIAL);
+
+    auto header = (const ArchiveHeader*)m_Data;
+    m_Count = header->m_Count;
+    m_Offsets = (const uint64_t*)(m_Data + sizeof(ArchiveHeader));
+    m_Coords = (const int32_t*)(m_Offsets + m_Count + 1);
+
+    // the offsets must not decrease, a polygon would otherwise span a negative number of points
+    size_t tableEnd = sizeof(ArchiveHeader) + (m_Count + 1) * sizeof(uint64_t);
+    bool valid = !memcmp(header->m_Magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) && header->m_Version == ARCHIVE_VERSION
+                 && m_Count < m_Size / sizeof(uint64_t) && tableEnd <= m_Size
+                 && m_Offsets[m_Count] <= (m_Size - tableEnd) / (2 * sizeof(int32_t));
+    for(size_t i = 0; valid && i < m_Count; ++i) valid = m_Offsets[i] <= m_Offsets[i + 1];
+    if(!valid){
+        munmap(data, m_Size);
+        throw runtime_error("invalid archive " + archive);
+    }
+
+    if(!(m_Out = fopen(output.c_str(), "w"))){
+        munmap(data, m_Size);
+        throw runtime_error("cannot create " + output);
+    }
+    setvbuf(m_Out, nullptr, _IOFBF, 1 << 20);
+}
+
+
+CArchiveCompany::~CArchiveCompany() noexcept
+{
+    fclose(m_Out);
+    munmap((void*)m_Data, m_Size);
+}
+
+
+AProblemPack CArchiveCompany::waitForPack()
+{
+    if(m_Next == m_Count) return nullptr;
+
+    size_t cnt = min(PACK_SIZE, m_Count - m_Next);
+    auto arena = make_shared<vector<CPolygon>>(cnt);
+    auto pack = make_shared<CProblemPack>();
+
+    for(size_t i = 0; i < cnt; ++i, ++m_Next){
+        auto & points = (*arena)[i].m_Points;
+        const int32_t * coords = m_Coords + 2 * m_Offsets[m_Next];
+        const int32_t * end = m_Coords + 2 * m_Offsets[m_Next + 1];
+
+        points.reserve((end - coords) / 2);
+        for(; coords < end; coords += 2) points.emplace_back(coords[0], coords[1]);
+
+        APolygon polygon(arena, &(*arena)[i]);
+        if(m_Min) pack->addMin(polygon);
+        if(m_Cnt) pack->addCnt(std::move(polygon));
+    }
+    return pack;
+}
+
+
+// Called in the delivery order, the polygons are the same in both lists if both results are requested
+void CArchiveCompany::solvedPack(AProblemPack pack)
+{
+    auto & polygons = m_Min ? pack->m_ProblemsMin : pack->m_ProblemsCnt;
+    for(auto & p : polygons){
+        if(m_Min) fprintf(m_Out, "%.6f", p->m_TriangMin);
+        if(m_Cnt) fprintf(m_Out, "%s%s", m_Min ? " " : "", p->m_TriangCnt.toString().c_str());
+        fputc('\n', m_Out);
+    }
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static int convert(const string & text, const string & archive)
+{
+    ifstream in(text);
+    if(!in){
+        cerr << "cannot open " << text << endl;
+        return 1;
+    }
+
+    vector<uint64_t> offsets{0};
+    vector<int32_t> coords;
+    for(string line; getline(in, line);){
+        istringstream iss(line);
+        for(int32_t c; iss >> c;) coords.push_back(c);
+        if(coords.size() % 2){
+            cerr << "odd number of coordinates on line " << offsets.size() << endl;
+            return 1;
+        }
+        if(coords.size() / 2 != offsets.back()) offsets.push_back(coords.size() / 2);
+    }
+
+    ArchiveHeader header{};
+    memcpy(header.m_Magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.m_Version = ARCHIVE_VERSION;
+    header.m_Count = offsets.size() - 1;
+
+    ofstream out(archive, ios::binary);
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)offsets.data(), offsets.size() * sizeof(uint64_t));
+    out.write((const char*)coords.data(), coords.size() * sizeof(int32_t));
+    if(!out){
+        cerr << "cannot write " << archive << endl;
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, char * argv[])
+{
+    int threads = (int)max(1u, thread::hardware_concurrency());
+    string mode = "both";
+    double batchMillis = 0;
+    string store;
+    size_t processes = 0;
+    bool library = false;
+    size_t memo = 0;
+    CCompanyConfig config;
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:m:b:s:p:lM:ac:")) != -1){
+        switch(opt){
+            case 't': threads = max(1, atoi(optarg)); break;
+            case 'm': mode = optarg; break;
+            case 'b': batchMillis = atof(optarg); break;
+            case 's': store = optarg; break;
+            case 'p': processes = atoi(optarg); break;
+            case 'l': library = true; break;
+            case 'M': memo = strtoull(optarg, nullptr, 10); break;
+            case 'a': config.m_ApproxMin = true; break;
+            case 'c': return optind < argc ? convert(optarg, argv[optind]) : 1;
+            default: return 1;
+        }
+    }
+    if(argc - optind != 2 || (mode != "min" && mode != "cnt" && mode != "both")){
+        cerr << "usage: " << argv[0] << " [-t threads] [-m min|cnt|both] [-b batchMs] [-s store] [-p processes] [-l] [-M entries] [-a] archive output" << endl
+             << "       " << argv[0] << " -c polygons.txt archive" << endl;
+        return 1;
+    }
+
+    try{
+        auto company = make_shared<CArchiveCompany>(argv[optind], argv[optind + 1], mode != "cnt", mode != "min");
+        COptimizer optimizer;
+        optimizer.addCompany(company, config);
+        // keeps the number of materialized packs proportional to the number of workers
+        optimizer.setMaxInFlight(4 * threads);
+        optimizer.useSizeClasses(batchMillis);
+        optimizer.useResultStore(store);
+        optimizer.useWorkerProcesses(processes);
+        optimizer.useNativeSolvers(!library);
+        if(library) optimizer.useSolverBudget(COptimizer::DELIVERED_BUDGET);
+        optimizer.useChainMemo(memo);
+        optimizer.start(threads);
+        optimizer.stop();
+    }
+    catch(const exception & e){
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Microbenchmarks of the arithmetic behind the counting problems (CBigInt) and of the native DP kernels
+// (CTriangulation, regular convex polygons). Every case repeats the operation for at least MIN_TIME and reports
+// the time per operation and the throughput of the bytes the operation touches:
+//   ./microbench [filter]     (runs the cases whose name contains filter, see the micro target in the Makefile)
+#define SOLUTION_NO_MAIN
+#include "solution.cpp"
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static constexpr chrono::milliseconds MIN_TIME(200);
+
+// keeps the compiler from dropping the computation of x
+template<typename T>
+static void keep(T & x)
+{
+    asm volatile("" : : "g"(&x) : "memory");
+}
+
+
+// op() performs opsPerCall operations touching bytesPerOp bytes each
+template<typename F>
+static void measure(const string & filter, const string & name, double opsPerCall, double bytesPerOp, F && op)
+{
+    if(name.find(filter) == string::npos) return;
+
+    op();
+    size_t calls = 0;
+    auto begin = chrono::steady_clock::now(), end = begin;
+    while(end - begin < MIN_TIME){
+        op();
+        calls++;
+        end = chrono::steady_clock::now();
+    }
+
+    double ns = chrono::duration<double, nano>(end - begin).count() / (calls * opsPerCall);
+    cout << left << setw(28) << name << right << fixed << setprecision(2)
+         << setw(14) << ns << " ns/op" << setw(10) << bytesPerOp / ns << " GB/s" << endl;
+}
+
+
+// about 3.32 * digits bits
+static string decimal(size_t digits)
+{
+    string res(digits, '7');
+    res[0] = '1';
+    return res;
+}
+
+
+static APolygon regularPolygon(size_t n)
+{
+    vector<CPoint> points;
+    for(size_t i = 0; i < n; ++i){
+        double angle = 2 * M_PI * i / n;
+        points.emplace_back((int)lround(1e8 * cos(angle)), (int)lround(1e8 * sin(angle)));
+    }
+    return make_shared<CPolygon>(std::move(points));
+}
+
+
+// (i, k, j) triples visited by the interval DP
+static double triples(size_t n)
+{
+    double res = 0;
+    for(size_t len = 2; len < n; ++len) res += (double)(n - len) * (len - 1);
+    return res;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static void benchBigInt(const string & filter)
+{
+    constexpr double BIGINT = sizeof(CBigInt);
+
+    for(size_t digits : {19, 77, 154, 308}){
+        string text = decimal(digits), suffix = "/" + to_string(digits) + "d";
+        CBigInt x(text), y(text);
+
+        measure(filter, "bigint +=" + suffix, 1, 3 * BIGINT, [&] { x += y; keep(x); });
+        measure(filter, "bigint *=" + suffix, 1, 3 * BIGINT, [&] { CBigInt r(y); r *= y; keep(r); });
+        measure(filter, "bigint toString" + suffix, 1, BIGINT + digits, [&] { auto s = y.toString(); keep(s); });
+        measure(filter, "bigint string ctor" + suffix, 1, BIGINT + digits, [&] { CBigInt r(text); keep(r); });
+    }
+}
+
+
+static void benchKernels(const string & filter)
+{
+    for(size_t n : {10, 20, 50, 100, 200, 500, 1000, 2000}){
+        auto p = regularPolygon(n);
+        measure(filter, "dp min/n=" + to_string(n), triples(n), 2 * sizeof(double), [&] { COptimizer::checkAlgorithmMin(p); });
+    }
+    for(size_t n : {10, 20, 50, 100, 200}){
+        auto p = regularPolygon(n);
+        measure(filter, "dp cnt/n=" + to_string(n), triples(n), 2 * sizeof(CBigInt), [&] { COptimizer::checkAlgorithmCnt(p); });
+    }
+}
+
+
+int main(int argc, char * argv[])
+{
+    string filter = argc > 1 ? argv[1] : "";
+    benchBigInt(filter);
+    benchKernels(filter);
+    return 0;
+}
@@ -107,4 +107,21 @@ bool                                   CCompanyTest::allProcessed              (
          && m_CntPos == g_Data . size ()
          && m_CntDone == g_Data . size ();
 }
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+size_t                                 checkSampleAlgorithms                   ( void                               (* checkMin) ( APolygon ),
+                                                                                 void                               (* checkCnt) ( APolygon ) )
+{
+  size_t errors = 0;
+  for ( const auto & data : g_Data )
+  {
+    APolygon p = std::make_shared<CPolygon> ( data . m_Polygon -> m_Points );
+    checkMin ( p );
+    checkCnt ( p );
+    if ( ! smallDiff ( p -> m_TriangMin, data . m_TriangMin ) )
+      errors ++;
+    if ( p -> m_TriangCnt != CBigInt ( data . m_TriangCnt ) )
+      errors ++;
+  }
+  return errors;
+}
 //=============================================================================================================================================================
@@ -44,4 +44,14 @@ class CCompanyTest : public CCompany
 };
 using ACompanyTest = std::shared_ptr<CCompanyTest>;
 //=============================================================================================================================================================
+/**
+ * Runs the given check algorithms on copies of the sample polygons and compares the results with the reference ones.
+ *
+ * @param[in] checkMin    computes m_TriangMin of the polygon
+ * @param[in] checkCnt    computes m_TriangCnt of the polygon
+ * @return the number of the results different from the reference
+ */
+size_t                                 checkSampleAlgorithms                   ( void                               (* checkMin) ( APolygon ),
+                                                                                 void                               (* checkCnt) ( APolygon ) );
+//=============================================================================================================================================================
 #endif /* SAMPLE_TESTER_H_2983745628345129345 */
@@ -38,22 +38,131 @@
 #include "progtest_solver.h"
 #include "sample_tester.h"
 using namespace std;
+
+// The Progtest's environment provides the headers above only, the features needing more are compiled outside of it
+#include <coroutine>
+#include <fstream>
+#include <sched.h>
+#include <shared_mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
 #endif /* __PROGTEST__ */
 
 enum SolverType{
     MIN, CNT, END
 };
 
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// Event tracing of the pipeline, compiled in with -DOPTIMIZER_TRACE only. Otherwise TRACE expands to nothing and
+// its arguments are not evaluated.
+#ifdef OPTIMIZER_TRACE
+/**
+ * Per thread ring buffers keeping the newest RING_SIZE timestamped events of every thread. A ring is written by its
+ * thread only, without locks. dump() writes the Chrome trace JSON (chrome://tracing, Perfetto), it is meant to be
+ * called once the traced threads are done, e.g. after COptimizer::stop.
+ */
+class CTraceLog
+{
+public:
+    // phase as in the Chrome trace format: 'B' begin, 'E' end, 'i' instant
+    static void record(const char * name, char phase, uint64_t arg){
+        auto & ring = local();
+        size_t head = ring.m_Head.load(memory_order_relaxed);
+        ring.m_Events[head % RING_SIZE] = {name, phase, now(), arg};
+        ring.m_Head.store(head + 1, memory_order_release);
+    }
+
+    static void dump(const string & fileName){
+        ofstream out(fileName);
+        out << "{\"traceEvents\":[";
+        const char * separator = "\n";
+
+        lock_guard<mutex> lock(registry().m_Mtx);
+        for(auto & ring : registry().m_Rings){
+            size_t head = ring->m_Head.load(memory_order_acquire);
+            for(size_t i = head > RING_SIZE ? head - RING_SIZE : 0; i < head; ++i){
+                auto & e = ring->m_Events[i % RING_SIZE];
+                out << separator << "{\"name\":\"" << e.m_Name << "\",\"ph\":\"" << e.m_Phase << "\",\"ts\":" << fixed << setprecision(3)
+                    << e.m_Time / 1000.0 << ",\"pid\":0,\"tid\":" << ring->m_Tid << (e.m_Phase == 'i' ? ",\"s\":\"t\"" : "")
+                    << ",\"args\":{\"arg\":" << e.m_Arg << "}}";
+                separator = ",\n";
+            }
+        }
+        out << "\n]}\n";
+    }
+private:
+    static constexpr size_t RING_SIZE = 1 << 15;
+
+    struct CEvent
+    {
+        const char * m_Name;
+        char m_Phase;
+        uint64_t m_Time;
+        uint64_t m_Arg;
+    };
+
+    struct CRing
+    {
+        size_t m_Tid = 0;
+        atomic<size_t> m_Head{0};
+        CEvent m_Events[RING_SIZE];
+    };
+
+    // the rings outlive their threads, the events of the finished threads are dumped as well
+    struct CRegistry
+    {
+        mutex m_Mtx;
+        vector<unique_ptr<CRing>> m_Rings;
+    };
+
+    static CRegistry & registry(){
+        static CRegistry registry;
+        return registry;
+    }
+
+    static CRing & local(){
+        thread_local CRing * ring = [] {
+            lock_guard<mutex> lock(registry().m_Mtx);
+            auto & rings = registry().m_Rings;
+            rings.push_back(make_unique<CRing>());
+            rings.back()->m_Tid = rings.size();
+            return rings.back().get();
+        }();
+        return *ring;
+    }
+
+    static uint64_t now(){
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+#define TRACE(name, phase, arg) CTraceLog::record(name, phase, arg)
+#else
+#define TRACE(name, phase, arg) ((void)0)
+#endif /* OPTIMIZER_TRACE */
+
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 template<typename T>
+T & headOf(queue<T> & q) { return q.front(); }
+
+template<typename T, typename C, typename L>
+const T & headOf(priority_queue<T, C, L> & q) { return q.top(); }
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+template<typename T, typename Q = queue<T>>
 class AtomicQueue
 {
 public:
-    explicit AtomicQueue(function<bool(queue<T> & q)> & pred) : m_Pred(std::move(pred)){}
+    explicit AtomicQueue(function<bool(Q & q)> & pred) : m_Pred(std::move(pred)){}
     T pop(){
         unique_lock<mutex> lock (g_Mtx);
         m_Cond.wait(lock, [&] (){ return !m_Queue.empty() && m_Pred(m_Queue);});
-        auto first = m_Queue.front(); m_Queue.pop();
+        auto first = headOf(m_Queue); m_Queue.pop();
         return first;
     }
 
@@ -61,15 +170,138 @@ public:
         unique_lock<mutex> lock(g_Mtx);
         m_Queue.emplace(std::move(data));
         m_Cond.notify_one();
+#ifndef __PROGTEST__
+        resumeWaiter(lock);
+#endif /* __PROGTEST__ */
+    }
+
+    // the lock orders the notification after a concurrent predicate check, so the wakeup cannot be lost
+    void notify() {
+        unique_lock<mutex> lock(g_Mtx);
+        m_Cond.notify_one();
+#ifndef __PROGTEST__
+        resumeWaiter(lock);
+#endif /* __PROGTEST__ */
+    }
+
+#ifndef __PROGTEST__
+    // Non-blocking pop for a coroutine consumer: either pops the element into out and returns false, or registers
+    // the coroutine, which is later handed to the resumer by push/notify with out already filled
+    bool suspend(coroutine_handle<> waiter, T & out){
+        lock_guard<mutex> lock(g_Mtx);
+        if(ready()){
+            out = headOf(m_Queue); m_Queue.pop();
+            return false;
+        }
+        m_Waiter = waiter; m_WaiterSlot = &out;
+        return true;
     }
 
-    void notify() {m_Cond.notify_one();}
+    void setResumer(function<void(coroutine_handle<>)> resumer) { m_Resumer = std::move(resumer); }
+#endif /* __PROGTEST__ */
 private:
+    bool ready() { return !m_Queue.empty() && m_Pred(m_Queue); }
+
+#ifndef __PROGTEST__
+
+    void resumeWaiter(unique_lock<mutex> & lock){
+        if(!m_Waiter || !ready()) return;
+        *m_WaiterSlot = headOf(m_Queue); m_Queue.pop();
+        auto waiter = m_Waiter; m_Waiter = nullptr;
+        lock.unlock();
+        m_Resumer(waiter);
+    }
+#endif /* __PROGTEST__ */
+
     mutex g_Mtx;
     condition_variable m_Cond;
-    queue<T> m_Queue;
-    function<bool(queue<T> & q)> m_Pred;
+    Q m_Queue;
+    function<bool(Q & q)> m_Pred;
+
+#ifndef __PROGTEST__
+    coroutine_handle<> m_Waiter;
+    T * m_WaiterSlot = nullptr;
+    function<void(coroutine_handle<>)> m_Resumer;
+#endif /* __PROGTEST__ */
+};
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+#ifndef __PROGTEST__
+/**
+ * Fire and forget coroutine, the executor starts it and the frame is freed when the body returns.
+ */
+struct CTask
+{
+    struct promise_type
+    {
+        CTask get_return_object() { return {coroutine_handle<promise_type>::from_promise(*this)}; }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { terminate(); }
+    };
+    coroutine_handle<> m_Handle;
+};
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * A small pool of threads resuming ready coroutines. stop() waits until all spawned coroutines retire.
+ */
+class CExecutor
+{
+public:
+    CExecutor() : m_Ready(m_Always) {}
+
+    void start(size_t threads){
+        for(size_t i = 0; i < threads; ++i)
+            m_Threads.emplace_back([this] { while(auto h = m_Ready.pop()) h.resume(); });
+    }
+
+    void spawn(CTask task){
+        {
+            lock_guard<mutex> lock(m_Mtx);
+            m_Live++;
+        }
+        schedule(task.m_Handle);
+    }
+
+    void schedule(coroutine_handle<> h) { m_Ready.push(h); }
+
+    void retire(){
+        {
+            lock_guard<mutex> lock(m_Mtx);
+            m_Live--;
+        }
+        m_Cond.notify_all();
+    }
+
+    void stop(){
+        {
+            unique_lock<mutex> lock(m_Mtx);
+            m_Cond.wait(lock, [this] { return !m_Live; });
+        }
+        for(size_t i = 0; i < m_Threads.size(); ++i) m_Ready.push(nullptr);
+        for(auto & th : m_Threads) th.join();
+        m_Threads.clear();
+    }
+
+    [[nodiscard]] size_t size() const { return m_Threads.size(); }
+private:
+    function<bool(queue<coroutine_handle<>> &)> m_Always = [](queue<coroutine_handle<>> &) { return true; };
+    AtomicQueue<coroutine_handle<>> m_Ready;
+    vector<thread> m_Threads;
+    mutex m_Mtx;
+    condition_variable m_Cond;
+    size_t m_Live = 0;
 };
+#endif /* __PROGTEST__ */
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+// The problems of a pack referenced in place, valid while the pack is unsolved. Passing these instead of copies of
+// the APolygons saves two atomic reference count updates per problem and hop.
+using CProblemRefs = vector<const APolygon*>;
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -78,6 +310,9 @@ struct AProblemPackWrapper
     AProblemPack m_Pack;
     size_t m_CompanyId;
     atomic<size_t> toBeSolved;
+    CProblemRefs m_Unsolved[END];   // the problems left for the solvers by COptimizer::answerAtIntake
+    double m_FinishTag = 0;
+    chrono::steady_clock::time_point m_Arrival = chrono::steady_clock::now();
 
     AProblemPackWrapper(AProblemPack pack, size_t companyId)
         : m_Pack(std::move(pack)), m_CompanyId(companyId), toBeSolved(m_Pack->m_ProblemsMin.size() + m_Pack->m_ProblemsCnt.size()){}
@@ -87,13 +322,51 @@ struct AProblemPackWrapper
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
+/**
+ * Per company scheduling parameters, see COptimizer::addCompany.
+ */
+struct CCompanyConfig
+{
+    unsigned m_Weight = 1;   // share of the solver capacity relative to the other companies
+    size_t m_Quota = 0;      // max problems of the company waiting in sealed solvers, 0 = unlimited
+    size_t m_MaxInFlight = 0;// max packs received from the company and not yet returned, 0 = unlimited
+    bool m_ApproxMin = false;// TriangMin by CApproxTriangulation at intake instead of the solvers
+    function<void(const CPolygon &, double)> m_ApproxGap;    // optional, gets each approximated polygon and its gap
+};
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
 struct ACompanyWrapper
 {
-    explicit ACompanyWrapper(ACompany company, function<bool(queue<AProblemPackWrapper*> &)> pred) :
-    m_Company(std::move(company)), m_Queue(pred) {}
+    explicit ACompanyWrapper(ACompany company, function<bool(queue<AProblemPackWrapper*> &)> pred, const CCompanyConfig & config) :
+    m_Company(std::move(company)), m_Queue(pred), m_Config(config) {}
     ACompany m_Company;
     AtomicQueue<AProblemPackWrapper*> m_Queue;
+    CCompanyConfig m_Config;
+
+    // fair queueing state, guarded by COptimizer::m_SchedMtx
+    queue<AProblemPackWrapper*> m_Pending;
+    double m_VirtualFinish = 0;
+    size_t m_Sealed = 0;
+
+    // guarded by COptimizer::m_InFlightMtx, the receiver waits on its own condition, a release wakes only its company
+    size_t m_InFlight = 0;
+    condition_variable m_InFlightCond;
+};
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+#ifndef __PROGTEST__
+// Suspends a submission coroutine until the head pack of its company is solved
+struct CSolvedAwaiter
+{
+    AtomicQueue<AProblemPackWrapper*> & m_Queue;
+    AProblemPackWrapper * m_Pack = nullptr;
+
+    bool await_ready() { return false; }
+    bool await_suspend(coroutine_handle<> h) { return m_Queue.suspend(h, m_Pack); }
+    AProblemPackWrapper * await_resume() { return m_Pack; }
 };
+#endif /* __PROGTEST__ */
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
@@ -108,210 +381,2008 @@ struct SolvedPackCounter
 
 struct Solver
 {
-    explicit Solver(AProgtestSolver solver) : m_Solver(std::move(solver)) {}
-    AProgtestSolver m_Solver;
+    static constexpr size_t NATIVE_BATCH = 32;
+
+    Solver(AProgtestSolver solver, SolverType type) : m_Solver(std::move(solver)), m_Type(type) {}
+    AProgtestSolver m_Solver; // null = the batch is solved by CTriangulation, see COptimizer::createSolver
+    size_t m_Instance = 0;    // creation order of m_Solver among its kind, see COptimizer::withinBudget
+    SolverType m_Type;
     vector<SolvedPackCounter> m_solved;
+    double m_Work = 0; // sum of CCostModel::work of the problems
+    vector<CPolygon*> m_Problems; // owned by the packs
+    chrono::steady_clock::time_point m_Deadline = chrono::steady_clock::time_point::max(); // arrival of the oldest pack
+
+    [[nodiscard]] bool hasFreeCapacity() const { return m_Solver ? m_Solver->hasFreeCapacity() : m_Problems.size() < NATIVE_BATCH; }
 };
 
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-class COptimizer
+// The sealed solver unblocking the oldest pack is solved first, the stop sentinels (null) go last
+struct CEarlierDeadline
 {
-  public:
-    COptimizer(function<bool(queue<Solver*>&)> pred = [](queue<Solver*>&) { return true; }) : m_ToSolve(pred){};
+    bool operator()(const Solver * a, const Solver * b) const {
+        return b && (!a || a->m_Deadline > b->m_Deadline);
+    }
+};
 
-    static bool usingProgtestSolver (){ return true;}
-    static void checkAlgorithmMin (APolygon p){}
-    static void checkAlgorithmCnt (APolygon p){}
+using SolverQueue = priority_queue<Solver*, vector<Solver*>, CEarlierDeadline>;
 
-    void start (int threadCount);
-    void stop ();
-    void addCompany (ACompany company);
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-    void workThread ();
-    void problemReceiver (ACompanyWrapper * company, int id);
-    void problemSubmitter (ACompanyWrapper * company, int id);
+/**
+ * Predicts the solve time of a polygon as rate * n^3 per solver kind. The rate is a moving average of the observed
+ * solve() time per unit of work, the prediction is 0 until the first solver of the kind is solved.
+ */
+class CCostModel
+{
+public:
+    static double work(const APolygon & p) { double n = (double)p->m_Points.size(); return n * n * n; }
 
-    void initSolvers();
-    void fillSolver(AProblemPackWrapper * pack);
-    void setNewSolver(SolverType type);
-    void finalizeSolvers();
+    [[nodiscard]] double predict(SolverType type, double work) const { return m_Rate[type].load(memory_order_relaxed) * work; }
 
+    void observe(SolverType type, double work, double seconds){
+        if(work <= 0) return;
+        double rate = m_Rate[type].load(memory_order_relaxed), observed = seconds / work;
+        while(!m_Rate[type].compare_exchange_weak(rate, rate ? rate + SMOOTHING * (observed - rate) : observed, memory_order_relaxed));
+    }
 private:
-    vector<thread>  m_WorkThreads;
-    vector<thread>  m_Receivers;
-    vector<thread>  m_Submitters;
-
-    deque<ACompanyWrapper> m_Companies;
-    AtomicQueue<Solver*> m_ToSolve;
+    static constexpr double SMOOTHING = 0.2;
+    atomic<double> m_Rate[END] = {};
+};
 
-    Solver * m_CntSolver;
-    Solver * m_MinSolver;
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-    mutex g_MtxMinSolver;
-    mutex g_MtxCntSolver;
+/**
+ * The open solver of one kind and size class. The solver always has free capacity, it is replaced by the spare as soon
+ * as it fills up. The spare is requested from the provisioner once the open solver gets its first problem, thus at most
+ * one instance per slot stays unused, as if it was created on demand. Without a spare m_Solver is null and the fillers wait.
+ */
+struct CSolverSlot
+{
+    mutex m_Mtx;
+    condition_variable m_Cond;
+    Solver * m_Solver = nullptr;
+    Solver * m_Spare = nullptr;
+    bool m_Requested = false;
+    SolverType m_Type = MIN;
+    AProgtestSolver (* m_Create)() = nullptr;
 };
+
 //-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-void COptimizer::initSolvers()
+/**
+ * Optional placement of the pipeline threads onto CPUs. All flags are off by default, the threads then float freely.
+ */
+struct CPlacementPolicy
 {
-    m_CntSolver = new Solver(createProgtestCntSolver());
-    m_MinSolver = new Solver(createProgtestMinSolver());
-}
-
+    bool m_PinWorkers = false;       // pin each worker thread to its own physical core
+    bool m_CoLocateCompany = false;  // run the receiver and the submitter of a company on the same logical CPU
+    bool m_IsolateIntake = false;    // keep receivers and submitters off the physical cores used by the workers
+};
 
-void COptimizer::workThread()
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+#ifndef __PROGTEST__
+/**
+ * Append-only file of solved problems keyed by the canonical polygon hash, the hash does not depend on the starting
+ * vertex nor on the orientation. A second hash with another seed is stored along and must match on lookup, a result
+ * is only returned for a 128 bit match. open() memory-maps the file and indexes the records, the results solved later
+ * are appended. A truncated last record (a crash while appending) is cut off.
+ *
+ * Layout (native byte order): char magic[4] = "PRST", uint32_t version, then the records
+ *   uint64_t hash, uint64_t check, uint32_t type (MIN / CNT), uint32_t size, followed by size bytes of the result:
+ *   double m_TriangMin for MIN, the decimal digits of m_TriangCnt for CNT
+ */
+class CResultStore
 {
-    while(true)
-    {
-        auto solver = m_ToSolve.pop();
-        if(!solver) break;
+public:
+    CResultStore() = default;
+    CResultStore(const CResultStore &) = delete;
+    CResultStore & operator=(const CResultStore &) = delete;
+    ~CResultStore() noexcept;
 
-        solver->m_Solver->solve();
+    void open(const string & fileName);
+    [[nodiscard]] bool isOpen() const { return m_Fd >= 0; }
+    bool lookup(SolverType type, CPolygon & p) const;    // fills the result in on a hit
+    void append(SolverType type, const vector<CPolygon*> & problems);
+    static uint64_t hash(const vector<CPoint> & points, uint64_t seed = 0);
+private:
+    static constexpr char MAGIC[4] = {'P', 'R', 'S', 'T'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t CHECK_SEED = 0x9e3779b97f4a7c15ULL;
 
-        for(auto & solved : solver->m_solved){
-            solved.m_Pack->toBeSolved -= solved.m_Counter;
+    struct CRecord
+    {
+        uint64_t m_Hash;
+        uint64_t m_Check;
+        uint32_t m_Type;
+        uint32_t m_Size;
+    };
 
-            if(!solved.m_Pack->toBeSolved){
-                size_t id = solved.m_Pack->m_CompanyId;
-                m_Companies[id].m_Queue.notify();
-            }
-        }
-        delete solver;
-    }
-}
+    size_t load(const uint8_t * data, size_t size);
+
+    mutable shared_mutex m_Mtx;     // the receiving threads look up, the workers append
+    unordered_map<uint64_t, pair<uint64_t, double>> m_Min;     // hash -> check, result
+    unordered_map<uint64_t, pair<uint64_t, CBigInt>> m_Cnt;
+    int m_Fd = -1;
+};
+#endif /* __PROGTEST__ */
 
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-void COptimizer::problemReceiver (ACompanyWrapper * company, int id)
+/**
+ * Process wide memo of the DP values of sub-polygons, shared by all problems solved in the process. The value of the
+ * sub-polygon i..j depends on the vertex chain i..j only (the closing diagonal i-j is valid, thus the diagonals inside
+ * lie within the chain), so related polygons sharing a chain reuse each other's work. Sharded, a lookup locks one
+ * shard. Inserts beyond the capacity are dropped. A forked process fills its own copy, the parent never sees it.
+ */
+template<typename V>
+class CChainMemo
 {
-    while(true)
-    {
-        auto pack = company->m_Company->waitForPack();
-        auto packWrap = pack ? new AProblemPackWrapper(pack, id) : nullptr;
+public:
+    void setCapacity(size_t entries) { m_Capacity = entries; }
+    [[nodiscard]] bool enabled() const { return m_Capacity; }
 
-        company->m_Queue.push(packWrap);
-        if(!pack) break;
-        fillSolver(packWrap);
+    bool find(uint64_t key, V & out){
+        auto & shard = m_Shards[key % SHARDS];
+        lock_guard<mutex> lock(shard.m_Mtx);
+        auto it = shard.m_Map.find(key);
+        if(it == shard.m_Map.end()) return false;
+        out = it->second;
+        return true;
     }
-}
 
+    void insert(const vector<pair<uint64_t, V>> & values){
+        for(auto & [key, value] : values){
+            if(m_Size.load(memory_order_relaxed) >= m_Capacity) return;
+            auto & shard = m_Shards[key % SHARDS];
+            lock_guard<mutex> lock(shard.m_Mtx);
+            if(shard.m_Map.emplace(key, value).second) m_Size.fetch_add(1, memory_order_relaxed);
+        }
+    }
+private:
+    static constexpr size_t SHARDS = 64;
 
-void COptimizer::problemSubmitter (ACompanyWrapper * company, int id)
-{
-    while(true)
+    struct CShard
     {
-        auto solved = company->m_Queue.pop();
-        if(!solved) break;
+        mutex m_Mtx;
+        unordered_map<uint64_t, V> m_Map;
+    };
 
-        company->m_Company->solvedPack(solved->m_Pack);
-        delete solved;
-    }
-}
+    CShard m_Shards[SHARDS];
+    atomic<size_t> m_Size{0};
+    size_t m_Capacity = 0;
+};
 
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-void COptimizer::setNewSolver(SolverType type)
+/**
+ * Interval DP engines of the native algorithms. The sub-polygon i..j (i < j, the chain i, i+1, ..., j closed by i-j)
+ * is triangulated by a triangle i, k, j whose sides are polygon edges or valid diagonals. The polygon must be simple,
+ * either orientation. When less than SPARSE_DENSITY of the vertex pairs are valid diagonals (spirals, combs), only
+ * the valid pairs are stored and the apexes k are taken from the adjacency lists of the valid diagonals instead of
+ * scanning the whole interval.
+ */
+class CTriangulation
 {
-    switch (type){
-        case MIN:
-            m_ToSolve.push(m_MinSolver);
-            m_MinSolver = new Solver(createProgtestMinSolver());
-            break;
-        case CNT:
-            m_ToSolve.push(m_CntSolver);
-            m_CntSolver = new Solver(createProgtestCntSolver());
-            break;
-        case END:
-            if(!m_MinSolver->m_solved.empty()) m_ToSolve.push(m_MinSolver);
-            if(!m_CntSolver->m_solved.empty()) m_ToSolve.push(m_CntSolver);
-            break;
-    }
-}
+public:
+    // the points are referenced, they must outlive the object
+    CTriangulation(const CPoint * points, size_t n);
+    explicit CTriangulation(const vector<CPoint> & points) : CTriangulation(points.data(), points.size()) {}
 
+    [[nodiscard]] double minWeight() const;   // total length of the edges and the diagonals
+    [[nodiscard]] CBigInt count() const;
+    [[nodiscard]] bool valid(size_t i, size_t j) const { return m_Valid[i * m_N + j]; }
 
-void COptimizer::fillSolver(AProblemPackWrapper * pack)
-{
-    g_MtxMinSolver.lock();
-    m_MinSolver->m_solved.emplace_back(pack);
+    // Memoizes the sub-polygons of at least MEMO_CHAIN vertices across problems, up to entries per kind, 0 = off
+    static void useChainMemo(size_t entries);
 
-    for(auto & p : pack->m_Pack->m_ProblemsMin){
-        if(!m_MinSolver->m_Solver->hasFreeCapacity()){
-            setNewSolver(MIN);
-            m_MinSolver->m_solved.emplace_back(pack);
-        }
+    static long long cross(const CPoint & o, const CPoint & a, const CPoint & b);
+    // b lies strictly inside the interior angle prev, a, next of a polygon with the given orientation (+1 / -1)
+    static bool inCone(const CPoint & prev, const CPoint & a, const CPoint & next, const CPoint & b, long long orientation);
+private:
+    static constexpr size_t MEMO_CHAIN = 5;
+    static constexpr double SPARSE_DENSITY = 0.2;
+    static constexpr uint64_t HASH_MOD = (1ULL << 61) - 1;
 
-        m_MinSolver->m_Solver->addPolygon(p);
-        m_MinSolver->m_solved.back().m_Counter++;
-    }
-    if(!m_MinSolver->m_Solver->hasFreeCapacity()) setNewSolver(MIN);
-    g_MtxMinSolver.unlock();
+    inline static CChainMemo<double> s_MinMemo;
+    inline static CChainMemo<CBigInt> s_CntMemo;
 
+    static uint64_t mulMod(uint64_t a, uint64_t b);
+    void hashChains();
+    uint64_t chainKey(size_t i, size_t j) const;
+    template<typename F>
+    void forEachApex(size_t i, size_t j, F && f) const;
+    template<typename V, typename Solve>
+    vector<V> sparseTable(const V & edge, CChainMemo<V> & memo, Solve && solve) const;
+    [[nodiscard]] uint32_t cell(size_t i, size_t j) const { return m_Cell[i * m_N + j]; }
+    double length(size_t i, size_t j) const;
+    bool convex() const;
+    bool diagonal(size_t i, size_t j) const;
 
-    g_MtxCntSolver.lock();
-    m_CntSolver->m_solved.emplace_back(pack);
+    const CPoint * m_Points;
+    size_t m_N;
+    long long m_Orientation = 0;
+    vector<char> m_Valid;  // n x n, both triangles
 
-    for(auto & p : pack->m_Pack->m_ProblemsCnt)
-    {
-        if(!m_CntSolver->m_Solver->hasFreeCapacity()){
-            setNewSolver(CNT);
-            m_CntSolver->m_solved.emplace_back(pack);
-        }
-        m_CntSolver->m_Solver->addPolygon(p);
-        m_CntSolver->m_solved.back().m_Counter++;
-    }
-    if(!m_CntSolver->m_Solver->hasFreeCapacity()) setNewSolver(CNT);
-    g_MtxCntSolver.unlock();
-}
+    // sparse mode, m_Out[i] = valid k > i, m_In[j] = valid k < j, both ascending. m_Pairs are the valid pairs i < j
+    // ordered by j - i, m_Cell maps a pair to its index in m_Pairs.
+    bool m_Sparse = false;
+    vector<vector<uint32_t>> m_Out, m_In;
+    vector<pair<uint32_t, uint32_t>> m_Pairs;
+    vector<uint32_t> m_Cell;
 
+    // polynomial hashes mod 2^61 - 1 of the prefixes of the vertex sequence, filled for the memo only
+    vector<uint64_t> m_Prefix, m_Powers;
+};
 
-void COptimizer::finalizeSolvers()
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Approximate minimum weight triangulation for triage, O(n^2). Ear clipping always cuts the ear with the shortest
+ * closing diagonal, then diagonals of convex quadrilaterals are flipped to the shorter one while the weight drops.
+ * The lower bound is the perimeter plus the n - 3 shortest candidate diagonals (inside the interior angle at both
+ * ends), every triangulation uses n - 3 distinct valid diagonals. A degenerate input without an ear is solved exactly.
+ */
+class CApproxTriangulation
 {
-    unique_lock<mutex> minLock (g_MtxMinSolver), cntLock (g_MtxCntSolver);
-    setNewSolver(END);
-}
+public:
+    CApproxTriangulation(const CPoint * points, size_t n);
+    explicit CApproxTriangulation(const vector<CPoint> & points) : CApproxTriangulation(points.data(), points.size()) {}
+
+    [[nodiscard]] double weight() const { return m_Weight; }
+    [[nodiscard]] double lowerBound() const { return m_LowerBound; }
+    // relative distance of the weight from the lower bound, the error of the weight is at most that
+    [[nodiscard]] double gap() const { return m_LowerBound > 0 ? (m_Weight - m_LowerBound) / m_LowerBound : 0; }
+private:
+    bool clipEars();
+    void flipEdges();
+    void bound();
+    double length(size_t i, size_t j) const;
 
+    const CPoint * m_Points;
+    size_t m_N;
+    long long m_Orientation = 0;
+    double m_Perimeter = 0;
+    vector<array<uint32_t, 3>> m_Triangles;
+    double m_Weight = 0;
+    double m_LowerBound = 0;
+};
 
-void COptimizer::start ( int threadCount )
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+#ifndef __PROGTEST__
+/**
+ * A forked worker process solving sealed batches by CTriangulation, the progtest solvers cannot leave the parent.
+ * The process shares one anonymous mapping with the parent: a ring of requested slot indices with a single consumer
+ * (the producers are serialized by m_Mtx) and one slot per parent work thread. The batch is copied into the slot once,
+ * the process writes the results back in place and posts the slot. A crashed process is noticed by the waiting
+ * threads, solve() then fails and the remaining batches are solved in the parent.
+ */
+class CProcessShard
 {
-    initSolvers();
+public:
+    explicit CProcessShard(size_t slots);
+    ~CProcessShard() noexcept;
+    CProcessShard(const CProcessShard &) = delete;
+    CProcessShard & operator=(const CProcessShard &) = delete;
 
-    for(size_t i = 0; i < m_Companies.size(); ++i){
-        m_Receivers.emplace_back(&COptimizer::problemReceiver, this, &m_Companies[i], i);
-        m_Submitters.emplace_back(&COptimizer::problemSubmitter, this, &m_Companies[i], i);
-    }
+    // Blocks until the process solved the problems, false if the batch does not fit the slot or the process is gone
+    bool solve(size_t slot, SolverType type, const vector<CPolygon*> & problems);
+private:
+    static constexpr size_t SLOT_BYTES = 8 << 20;
+    static constexpr uint32_t STOP = UINT32_MAX;
+    static constexpr chrono::milliseconds LIVENESS_CHECK{100};
 
-    for (int i = 0; i < threadCount; ++i)
-        m_WorkThreads.emplace_back(&COptimizer::workThread, this);
-}
+    struct CSlot { sem_t m_Done; uint32_t m_Type; uint32_t m_Count; };       // followed by m_Count records
+    struct CRecord { CBigInt m_Cnt; double m_Min; uint64_t m_Size; };        // followed by m_Size points
+    static_assert(is_trivially_copyable_v<CBigInt> && is_trivially_copyable_v<CPoint>);
 
+    static size_t recordSize(size_t points) { return sizeof(CRecord) + points * sizeof(CPoint); }
+    sem_t * queued() const { return (sem_t*)m_Shm; }
+    uint32_t * ring() const { return (uint32_t*)(m_Shm + sizeof(sem_t)); }
+    CSlot * slot(size_t i) const { return (CSlot*)(m_Shm + m_RingBytes + i * SLOT_BYTES); }
+    void push(uint32_t slot);
+    bool alive();
+    void serve();
 
-void COptimizer::stop ()
-{
-    for(auto & th : m_Receivers) th.join();
-    finalizeSolvers();
-    for(size_t i = 0; i < m_WorkThreads.size(); ++i) m_ToSolve.push(nullptr);
-    for(auto & th : m_WorkThreads) th.join();
-    for(auto & th : m_Submitters) th.join();
-}
+    size_t m_Slots;
+    size_t m_Capacity;       // of the ring, every slot has at most one request queued plus the final STOP
+    size_t m_RingBytes;
+    size_t m_Size;
+    uint8_t * m_Shm = nullptr;
+    pid_t m_Pid = -1;
 
+    mutex m_Mtx;
+    size_t m_Head = 0;
+    bool m_Dead = false;
+};
+#endif /* __PROGTEST__ */
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-void COptimizer::addCompany ( ACompany company )
+class COptimizer
 {
-    std::function<bool(queue<AProblemPackWrapper*> & q)> isFirstSolved =
-            [] (queue<AProblemPackWrapper*> & q) {return !q.front() || !q.front()->toBeSolved;};
+  public:
+    COptimizer(function<bool(SolverQueue&)> pred = [](SolverQueue&) { return true; }) : m_ToSolve(pred){};
 
-    m_Companies.emplace_back(std::move(company), isFirstSolved);
-}
+    static constexpr size_t DELIVERED_BUDGET = 100; // M of the delivered progtest library, see useSolverBudget
 
-//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+    static bool usingProgtestSolver (){ return true;}
+    static void checkAlgorithmMin (APolygon p){ p->m_TriangMin = CTriangulation(p->m_Points).minWeight(); }
+    static void checkAlgorithmCnt (APolygon p){ p->m_TriangCnt = CTriangulation(p->m_Points).count(); }
+
+    void start (int threadCount, const CPlacementPolicy & placement = CPlacementPolicy());
+    void stop ();
+    void addCompany (ACompany company, const CCompanyConfig & config = CCompanyConfig());
+    void setMaxInFlight (size_t packs);
 #ifndef __PROGTEST__
-int main ()
-{
+    void useCoroutinePipeline (size_t executorThreads);
+#endif /* __PROGTEST__ */
+    void useSizeClasses (double batchMillis);
+#ifndef __PROGTEST__
+    void useResultStore (const string & fileName);
+#endif /* __PROGTEST__ */
+#ifndef __PROGTEST__
+    void useWorkerProcesses (size_t processes);
+#endif /* __PROGTEST__ */
+    void useNativeSolvers (bool native);
+    void useSolverBudget (size_t problems);
+    void useChainMemo (size_t entries);
+
+    void workThread (size_t id);
+    void scatterResults ();
+    void solveBatch (size_t worker, Solver * solver);
+    void problemReceiver (ACompanyWrapper * company, int id);
+    void problemSubmitter (ACompanyWrapper * company, int id);
+#ifndef __PROGTEST__
+    CTask submitCoroutine (ACompanyWrapper * company);
+#endif /* __PROGTEST__ */
+
+    void initSolvers();
+    void fillSolver(AProblemPackWrapper * pack);
+    void answerAtIntake(const ACompanyWrapper & company, AProblemPackWrapper * pack);
+    static void approximateMin(const CCompanyConfig & config, CPolygon & p);
+    void fillSlots(SolverType type, AProblemPackWrapper * pack, const CProblemRefs & problems);
+    void fillSlot(CSolverSlot & slot, AProblemPackWrapper * pack, const CProblemRefs & problems);
+    static Solver * detachSolver(CSolverSlot & slot);
+    Solver * createSolver(const CSolverSlot & slot);
+    void chargeBudget(Solver * solver);
+    bool withinBudget(const Solver & solver);
+    void exhausted(SolverType type);
+    static void solveNative(SolverType type, const vector<CPolygon*> & problems);
+    void provisionSolvers();
+    size_t sizeClass(const APolygon & p) const;
+    void finalizeSolvers();
+    void flushSolvers();
+
+    void waitInFlight(ACompanyWrapper * company);
+    void acquireInFlight(ACompanyWrapper * company);
+    void releaseInFlight(ACompanyWrapper * company);
+    bool atInFlightLimit(const ACompanyWrapper * company) const;
+    void awaitInFlight(ACompanyWrapper * company, unique_lock<mutex> & lock);
+    bool pipelineStalled();
+    void unblockIntake();
+
+    void schedulePack(AProblemPackWrapper * pack);
+    AProblemPackWrapper * nextPack();
+    void dispatchPacks();
+    void drainPacks();
+    void sealSolver(Solver * solver);
+    void releaseSolver(const Solver * solver);
+
+    static vector<vector<int>> physicalCores();
+    static void readTopologyId(const string & fileName, int & id);
+    static void pinThread(thread & th, int cpu);
+    void placeThreads(const CPlacementPolicy & placement);
+
+private:
+    vector<thread>  m_WorkThreads;
+    vector<thread>  m_Receivers;
+    vector<thread>  m_Submitters;
+
+    deque<ACompanyWrapper> m_Companies;
+    AtomicQueue<Solver*, SolverQueue> m_ToSolve;
+
+    // Solved batches waiting for the scatter thread, null stops it
+    function<bool(queue<Solver*>&)> m_AnySolved = [](queue<Solver*>&) { return true; };
+    AtomicQueue<Solver*> m_Solved{m_AnySolved};
+    thread m_Scatterer;
+
+    // Open solvers per kind and size class, only the first m_SizeClasses classes are used
+    static constexpr size_t SIZE_CLASSES = 4;
+    CSolverSlot m_Slots[END][SIZE_CLASSES];
+    size_t m_SizeClasses = 1;
+    double m_BatchCost = 0;
+    CCostModel m_Cost;
+
+#ifndef __PROGTEST__
+    // Results of the problems solved by the previous runs, opened at start if m_StoreFile is set
+    string m_StoreFile;
+    CResultStore m_Store;
+#endif /* __PROGTEST__ */
+
+    // All batches solved by CTriangulation, otherwise only once the progtest factory of the kind is exhausted
+    bool m_NativeSolvers = false;
+    atomic<bool> m_Exhausted[END] = {};
+
+    // Capacities of the progtest instances per kind in the creation order, 0 until the instance is sealed. The kind
+    // is exhausted once they sum up to m_Budget (0 = unknown budget).
+    size_t m_Budget = 0;
+    mutex m_BudgetMtx;
+    vector<size_t> m_Capacities[END];
+
+    // Worker processes forked by start (never in Progtest), work thread i ships its batches through slot i / size of
+    // shard i % size
+    size_t m_Processes = 0;
+#ifndef __PROGTEST__
+    vector<unique_ptr<CProcessShard>> m_Shards;
+#endif /* __PROGTEST__ */
+
+    // Creates the spare solvers off the fill path, null stops the provisioner
+    function<bool(queue<CSolverSlot*>&)> m_Always = [](queue<CSolverSlot*>&) { return true; };
+    AtomicQueue<CSolverSlot*> m_Provision{m_Always};
+    thread m_Provisioner;
+
+    // Weighted fair queueing (self-clocked) of the received packs in front of the solvers. Packs are admitted while
+    // less than m_MaxSealed solvers wait for a worker, the backlogged companies are ordered by the finish tag of their head pack.
+    mutex m_SchedMtx;
+    condition_variable m_SchedCond;
+    set<pair<double, size_t>> m_Backlogged;
+    double m_VirtualTime = 0;
+    size_t m_SealedSolvers = 0;
+    size_t m_MaxSealed = 1;
+    size_t m_Dispatching = 0;
+    bool m_Draining = false;
+
+    // Backpressure, a receiver does not wait for a new pack while its company or the whole optimizer is at the limit.
+    // A pack counts from its arrival until it is submitted, m_Throttled receivers are blocked at the limit.
+    mutex m_InFlightMtx;
+    size_t m_InFlight = 0;
+    size_t m_MaxInFlight = 0;
+    size_t m_Throttled = 0;
+
+#ifndef __PROGTEST__
+    // Coroutine pipeline, the companies are submitted by coroutines on a shared executor instead of per company threads
+    size_t m_ExecutorThreads = 0;
+    CExecutor m_Executor;
+#endif /* __PROGTEST__ */
+};
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+#ifndef __PROGTEST__
+CResultStore::~CResultStore() noexcept
+{
+    if(m_Fd >= 0) close(m_Fd);
+}
+
+
+void CResultStore::open(const string & fileName)
+{
+    int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st)){
+        if(fd >= 0) close(fd);
+        throw runtime_error("CResultStore: cannot open " + fileName);
+    }
+
+    size_t valid = 0;
+    if(st.st_size){
+        void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED){
+            valid = load((const uint8_t*)data, st.st_size);
+            munmap(data, st.st_size);
+        }
+        if(!valid){
+            close(fd);
+            throw runtime_error("CResultStore: invalid store " + fileName);
+        }
+    }
+    else{
+        char header[sizeof(MAGIC) + sizeof(VERSION)];
+        memcpy(header, MAGIC, sizeof(MAGIC));
+        memcpy(header + sizeof(MAGIC), &VERSION, sizeof(VERSION));
+        valid = write(fd, header, sizeof(header)) == sizeof(header) ? sizeof(header) : 0;
+    }
+
+    if(!valid || ftruncate(fd, valid) || lseek(fd, 0, SEEK_END) < 0){
+        close(fd);
+        throw runtime_error("CResultStore: cannot initialize " + fileName);
+    }
+    m_Fd = fd;
+}
+
+
+// Indexes the records, returns the size of the valid prefix or 0 for a foreign file
+size_t CResultStore::load(const uint8_t * data, size_t size)
+{
+    uint32_t version;
+    if(size < sizeof(MAGIC) + sizeof(version) || memcmp(data, MAGIC, sizeof(MAGIC))) return 0;
+    memcpy(&version, data + sizeof(MAGIC), sizeof(version));
+    if(version != VERSION) return 0;
+
+    size_t pos = sizeof(MAGIC) + sizeof(version);
+    for(CRecord record; size - pos >= sizeof(record); pos += sizeof(record) + record.m_Size){
+        memcpy(&record, data + pos, sizeof(record));
+        if(record.m_Size > size - pos - sizeof(record)) break;
+
+        const uint8_t * result = data + pos + sizeof(record);
+        if(record.m_Type == MIN && record.m_Size == sizeof(double)){
+            double min;
+            memcpy(&min, result, sizeof(double));
+            m_Min.emplace(record.m_Hash, make_pair(record.m_Check, min));
+        }
+        else if(record.m_Type == CNT){
+            // a corrupt record is skipped, CBigInt rejects the invalid digits and the values out of its range
+            try{
+                m_Cnt.emplace(record.m_Hash, make_pair(record.m_Check, CBigInt(string_view((const char*)result, record.m_Size))));
+            }
+            catch(const invalid_argument &){}
+            catch(const out_of_range &){}
+        }
+    }
+    return pos;
+}
+
+
+// A hash collision with another polygon is a miss, the check hash of the record differs
+bool CResultStore::lookup(SolverType type, CPolygon & p) const
+{
+    uint64_t key = hash(p.m_Points), check = hash(p.m_Points, CHECK_SEED);
+    shared_lock<shared_mutex> lock(m_Mtx);
+
+    if(type == MIN){
+        auto it = m_Min.find(key);
+        if(it == m_Min.end() || it->second.first != check) return false;
+        p.m_TriangMin = it->second.second;
+    }
+    else{
+        auto it = m_Cnt.find(key);
+        if(it == m_Cnt.end() || it->second.first != check) return false;
+        p.m_TriangCnt = it->second.second;
+    }
+    return true;
+}
+
+
+// One write per solved batch, the problems already stored are skipped. Of two polygons with the same hash only the
+// first one is stored, the other is recomputed after every restart.
+void CResultStore::append(SolverType type, const vector<CPolygon*> & problems)
+{
+    string buffer;
+    unique_lock<shared_mutex> lock(m_Mtx);
+
+    for(auto & p : problems){
+        CRecord record{hash(p->m_Points), hash(p->m_Points, CHECK_SEED), type, 0};
+        string cnt;
+        if(type == MIN){
+            if(!m_Min.emplace(record.m_Hash, make_pair(record.m_Check, p->m_TriangMin)).second) continue;
+            record.m_Size = sizeof(double);
+        }
+        else{
+            if(!m_Cnt.emplace(record.m_Hash, make_pair(record.m_Check, p->m_TriangCnt)).second) continue;
+            cnt = p->m_TriangCnt.toString();
+            record.m_Size = cnt.size();
+        }
+        buffer.append((const char*)&record, sizeof(record));
+        if(type == MIN) buffer.append((const char*)&p->m_TriangMin, sizeof(double));
+        else buffer += cnt;
+    }
+
+    // best effort, a failed write only costs the recomputation after a restart
+    if(!buffer.empty() && write(m_Fd, buffer.data(), buffer.size()) != (ssize_t)buffer.size())
+        cerr << "CResultStore: append failed" << endl;
+}
+
+
+// The vertices are hashed from the smallest one towards its smaller neighbour, the seed selects the hash function
+uint64_t CResultStore::hash(const vector<CPoint> & points, uint64_t seed)
+{
+    auto mix = [](uint64_t x) {
+        x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    };
+
+    size_t n = points.size();
+    uint64_t res = mix(n ^ seed);
+    if(!n) return res;
+
+    size_t start = min_element(points.begin(), points.end()) - points.begin();
+    bool forward = points[(start + 1) % n] < points[(start + n - 1) % n];
+    for(size_t i = 0; i < n; ++i){
+        auto & p = points[forward ? (start + i) % n : (start + n - i) % n];
+        res = mix(res + (((uint64_t)(uint32_t)p.m_X << 32 | (uint32_t)p.m_Y) ^ seed));
+    }
+    return res;
+}
+#endif /* __PROGTEST__ */
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+CTriangulation::CTriangulation(const CPoint * points, size_t n) : m_Points(points), m_N(n), m_Valid(m_N * m_N)
+{
+    for(size_t i = 0; i < m_N; ++i){
+        size_t next = (i + 1) % m_N;
+        m_Orientation += (long long)points[i].m_X * points[next].m_Y - (long long)points[next].m_X * points[i].m_Y;
+        m_Valid[i * m_N + next] = m_Valid[next * m_N + i] = 1;
+    }
+    m_Orientation = m_Orientation > 0 ? 1 : -1;
+
+    // all diagonals of a convex polygon are valid, the general test costs O(n) per diagonal
+    bool isConvex = convex();
+    size_t pairs = m_N;
+    for(size_t i = 0; i < m_N; ++i)
+        for(size_t j = i + 2; j < m_N; ++j){
+            if(!i && j == m_N - 1) continue;
+            pairs += m_Valid[i * m_N + j] = m_Valid[j * m_N + i] = isConvex || diagonal(i, j);
+        }
+
+    m_Sparse = m_N > 3 && pairs < SPARSE_DENSITY * m_N * (m_N - 1) / 2;
+    if(m_Sparse){
+        m_Out.resize(m_N);
+        m_In.resize(m_N);
+        m_Cell.resize(m_N * m_N);
+        for(size_t len = 1; len < m_N; ++len)
+            for(size_t i = 0, j = len; j < m_N; ++i, ++j)
+                if(valid(i, j)){
+                    m_Cell[i * m_N + j] = m_Pairs.size();
+                    m_Pairs.emplace_back(i, j);
+                }
+        for(size_t i = 0; i < m_N; ++i)
+            for(size_t j = i + 1; j < m_N; ++j)
+                if(valid(i, j)){
+                    m_Out[i].push_back(j);
+                    m_In[j].push_back(i);
+                }
+    }
+
+    if(s_MinMemo.enabled() || s_CntMemo.enabled()) hashChains();
+}
+
+
+void CTriangulation::useChainMemo(size_t entries)
+{
+    s_MinMemo.setCapacity(entries);
+    s_CntMemo.setCapacity(entries);
+}
+
+
+uint64_t CTriangulation::mulMod(uint64_t a, uint64_t b)
+{
+    __uint128_t product = (__uint128_t)a * b;
+    uint64_t res = (uint64_t)(product & HASH_MOD) + (uint64_t)(product >> 61);
+    return res >= HASH_MOD ? res - HASH_MOD : res;
+}
+
+
+void CTriangulation::hashChains()
+{
+    constexpr uint64_t BASE = 0x1f3d5b79a2c4e6f1ULL % HASH_MOD;
+    m_Prefix.assign(m_N + 1, 0);
+    m_Powers.assign(m_N + 1, 1);
+
+    for(size_t i = 0; i < m_N; ++i){
+        uint64_t x = ((uint64_t)(uint32_t)m_Points[i].m_X << 32 | (uint32_t)m_Points[i].m_Y) % HASH_MOD;
+        m_Prefix[i + 1] = (mulMod(m_Prefix[i], BASE) + x + 1) % HASH_MOD;
+        m_Powers[i + 1] = mulMod(m_Powers[i], BASE);
+    }
+}
+
+
+// Calls f(k) for every apex k in (i, j) with valid sides i-k and k-j, scans the shorter of the two adjacency lists
+template<typename F>
+void CTriangulation::forEachApex(size_t i, size_t j, F && f) const
+{
+    auto & out = m_Out[i], & in = m_In[j];
+    auto outEnd = lower_bound(out.begin(), out.end(), j);
+    auto inBegin = upper_bound(in.begin(), in.end(), i);
+
+    if(outEnd - out.begin() <= in.end() - inBegin){
+        for(auto k = out.begin(); k != outEnd; ++k)
+            if(valid(*k, j)) f(*k);
+    }
+    else
+        for(auto k = inBegin; k != in.end(); ++k)
+            if(valid(i, *k)) f(*k);
+}
+
+
+// Values of m_Pairs, edge for the polygon edges, solve(i, j, values) for the others unless memoized
+template<typename V, typename Solve>
+vector<V> CTriangulation::sparseTable(const V & edge, CChainMemo<V> & memo, Solve && solve) const
+{
+    vector<V> values(m_Pairs.size());
+    vector<pair<uint64_t, V>> computed;
+
+    for(size_t id = 0; id < m_Pairs.size(); ++id){
+        auto [i, j] = m_Pairs[id];
+        if(j == i + 1){
+            values[id] = edge;
+            continue;
+        }
+
+        uint64_t key = memo.enabled() && j - i + 1 >= MEMO_CHAIN ? chainKey(i, j) : 0;
+        if(key && memo.find(key, values[id])) continue;
+        values[id] = solve(i, j, values);
+        if(key) computed.emplace_back(key, values[id]);
+    }
+
+    memo.insert(computed);
+    return values;
+}
+
+
+// Hash of the vertices i..j, the same chain anywhere in any polygon gets the same key. 0 is reserved for "no key".
+uint64_t CTriangulation::chainKey(size_t i, size_t j) const
+{
+    uint64_t h = (m_Prefix[j + 1] + HASH_MOD - mulMod(m_Prefix[i], m_Powers[j + 1 - i])) % HASH_MOD;
+    return (h << 3 | 1) ^ ((uint64_t)(j - i) << 56);
+}
+
+
+long long CTriangulation::cross(const CPoint & o, const CPoint & a, const CPoint & b)
+{
+    return (long long)(a.m_X - o.m_X) * (b.m_Y - o.m_Y) - (long long)(a.m_Y - o.m_Y) * (b.m_X - o.m_X);
+}
+
+
+bool CTriangulation::inCone(const CPoint & prev, const CPoint & a, const CPoint & next, const CPoint & b, long long orientation)
+{
+    return orientation * cross(prev, a, next) > 0
+           ? orientation * cross(a, next, b) > 0 && orientation * cross(prev, a, b) > 0
+           : orientation * cross(a, next, b) > 0 || orientation * cross(prev, a, b) > 0;
+}
+
+
+double CTriangulation::length(size_t i, size_t j) const
+{
+    return hypot((double)m_Points[i].m_X - m_Points[j].m_X, (double)m_Points[i].m_Y - m_Points[j].m_Y);
+}
+
+
+// Strictly convex, every vertex turns to the same side
+bool CTriangulation::convex() const
+{
+    for(size_t i = 0; i < m_N; ++i)
+        if(m_Orientation * cross(m_Points[i], m_Points[(i + 1) % m_N], m_Points[(i + 2) % m_N]) <= 0) return false;
+    return true;
+}
+
+
+// i-j lies inside the polygon: it leaves i into the interior and neither crosses nor touches the boundary elsewhere
+bool CTriangulation::diagonal(size_t i, size_t j) const
+{
+    auto & p = m_Points;
+    const CPoint & prev = p[(i + m_N - 1) % m_N], & a = p[i], & next = p[(i + 1) % m_N], & b = p[j];
+
+    if(!inCone(prev, a, next, b, m_Orientation)) return false;
+
+    auto within = [](const CPoint & s, const CPoint & t, const CPoint & q) {
+        return min(s.m_X, t.m_X) <= q.m_X && q.m_X <= max(s.m_X, t.m_X) && min(s.m_Y, t.m_Y) <= q.m_Y && q.m_Y <= max(s.m_Y, t.m_Y);
+    };
+    // vertex k lies on the diagonal, or the edge k -> k + 1 crosses it
+    auto blocks = [&](size_t k) {
+        if(k == i || k == j) return false;
+        if(!cross(a, b, p[k]) && within(a, b, p[k])) return true;
+
+        size_t l = (k + 1) % m_N;
+        if(l == i || l == j) return false;
+        long long d1 = cross(a, b, p[k]), d2 = cross(a, b, p[l]), d3 = cross(p[k], p[l], a), d4 = cross(p[k], p[l], b);
+        return ((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0));
+    };
+
+    // most invalid diagonals of a highly non-convex polygon are blocked near i, the edges are scanned outwards from i
+    for(size_t t = 0; t < (m_N + 1) / 2; ++t)
+        if(blocks((i + t) % m_N) || blocks((i + m_N - 1 - t) % m_N)) return false;
+    return true;
+}
+
+
+// The column of the table is kept transposed, the inner loop then reads two contiguous rows. Invalid entries stay
+// infinite, thus the inner loop needs no validity test.
+double CTriangulation::minWeight() const
+{
+    size_t n = m_N;
+    if(n < 3) return 0;
+
+    double perimeter = 0;
+    for(size_t i = 0; i + 1 < n; ++i) perimeter += length(i, i + 1);
+
+    if(m_Sparse){
+        auto values = sparseTable<double>(0, s_MinMemo, [this] (size_t i, size_t j, const vector<double> & v) {
+            double best = INFINITY;
+            forEachApex(i, j, [&](size_t k) { best = min(best, v[cell(i, k)] + v[cell(k, j)]); });
+            return best + length(i, j);
+        });
+        return values[cell(0, n - 1)] + perimeter;
+    }
+
+    vector<double> rows(n * n, INFINITY), cols(n * n, INFINITY);
+    for(size_t i = 0; i + 1 < n; ++i) rows[i * n + i + 1] = cols[(i + 1) * n + i] = 0;
+
+    bool memo = s_MinMemo.enabled();
+    vector<pair<uint64_t, double>> computed;
+
+    for(size_t len = 2; len < n; ++len)
+        for(size_t i = 0, j = len; j < n; ++i, ++j){
+            if(!valid(i, j)) continue;
+            uint64_t key = memo && len + 1 >= MEMO_CHAIN ? chainKey(i, j) : 0;
+            if(key && s_MinMemo.find(key, rows[i * n + j])){
+                cols[j * n + i] = rows[i * n + j];
+                continue;
+            }
+
+            const double * row = &rows[i * n], * col = &cols[j * n];
+            double best = INFINITY;
+            for(size_t k = i + 1; k < j; ++k) best = min(best, row[k] + col[k]);
+            if(best < INFINITY) rows[i * n + j] = cols[j * n + i] = best + length(i, j);
+            if(key) computed.emplace_back(key, rows[i * n + j]);
+        }
+
+    s_MinMemo.insert(computed);
+    return rows[n - 1] + perimeter;
+}
+
+
+CBigInt CTriangulation::count() const
+{
+    size_t n = m_N;
+    if(n < 3) return 0;
+
+    if(m_Sparse){
+        auto values = sparseTable<CBigInt>(1, s_CntMemo, [this] (size_t i, size_t j, const vector<CBigInt> & v) {
+            CBigInt total;
+            forEachApex(i, j, [&](size_t k) { total += v[cell(i, k)] * v[cell(k, j)]; });
+            return total;
+        });
+        return values[cell(0, n - 1)];
+    }
+
+    vector<CBigInt> rows(n * n), cols(n * n);
+    for(size_t i = 0; i + 1 < n; ++i) rows[i * n + i + 1] = cols[(i + 1) * n + i] = 1;
+
+    bool memo = s_CntMemo.enabled();
+    vector<pair<uint64_t, CBigInt>> computed;
+
+    for(size_t len = 2; len < n; ++len)
+        for(size_t i = 0, j = len; j < n; ++i, ++j){
+            if(!valid(i, j)) continue;
+            uint64_t key = memo && len + 1 >= MEMO_CHAIN ? chainKey(i, j) : 0;
+            if(key && s_CntMemo.find(key, rows[i * n + j])){
+                cols[j * n + i] = rows[i * n + j];
+                continue;
+            }
+
+            const CBigInt * row = &rows[i * n], * col = &cols[j * n];
+            CBigInt total;
+            for(size_t k = i + 1; k < j; ++k)
+                if(!row[k].isZero() && !col[k].isZero()) total += row[k] * col[k];
+            rows[i * n + j] = cols[j * n + i] = total;
+            if(key) computed.emplace_back(key, total);
+        }
+
+    s_CntMemo.insert(computed);
+    return rows[n - 1];
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+CApproxTriangulation::CApproxTriangulation(const CPoint * points, size_t n) : m_Points(points), m_N(n)
+{
+    if(m_N < 3) return;
+    for(size_t i = 0; i < m_N; ++i){
+        size_t next = (i + 1) % m_N;
+        m_Orientation += (long long)points[i].m_X * points[next].m_Y - (long long)points[next].m_X * points[i].m_Y;
+        m_Perimeter += length(i, next);
+    }
+    m_Orientation = m_Orientation > 0 ? 1 : -1;
+
+    if(!clipEars()){
+        m_Weight = m_LowerBound = CTriangulation(points, m_N).minWeight();
+        return;
+    }
+    flipEdges();
+
+    // every diagonal is shared by two triangles, every edge belongs to one
+    m_Weight = m_Perimeter;
+    for(auto & t : m_Triangles) m_Weight += length(t[0], t[1]) + length(t[1], t[2]) + length(t[2], t[0]);
+    m_Weight /= 2;
+    bound();
+}
+
+
+double CApproxTriangulation::length(size_t i, size_t j) const
+{
+    return hypot((double)m_Points[i].m_X - m_Points[j].m_X, (double)m_Points[i].m_Y - m_Points[j].m_Y);
+}
+
+
+bool CApproxTriangulation::clipEars()
+{
+    auto & p = m_Points;
+    vector<uint32_t> prev(m_N), next(m_N);
+    for(size_t i = 0; i < m_N; ++i){
+        prev[i] = (i + m_N - 1) % m_N;
+        next[i] = (i + 1) % m_N;
+    }
+
+    // convex, no other remaining vertex inside or on the triangle
+    auto isEar = [&](uint32_t v) {
+        const CPoint & a = p[prev[v]], & b = p[v], & c = p[next[v]];
+        if(m_Orientation * CTriangulation::cross(a, b, c) <= 0) return false;
+        for(uint32_t u = next[next[v]]; u != prev[v]; u = next[u])
+            if(m_Orientation * CTriangulation::cross(a, b, p[u]) >= 0 && m_Orientation * CTriangulation::cross(b, c, p[u]) >= 0
+               && m_Orientation * CTriangulation::cross(c, a, p[u]) >= 0) return false;
+        return true;
+    };
+
+    set<pair<double, uint32_t>> ears;
+    vector<double> key(m_N, -1);     // the key of the vertex in ears, -1 = not an ear
+    auto update = [&](uint32_t v) {
+        if(key[v] >= 0) ears.erase({key[v], v});
+        key[v] = isEar(v) ? length(prev[v], next[v]) : -1;
+        if(key[v] >= 0) ears.emplace(key[v], v);
+    };
+    for(uint32_t v = 0; v < m_N; ++v) update(v);
+
+    uint32_t alive = 0;     // any vertex not clipped yet
+    for(size_t remaining = m_N; remaining > 3; --remaining){
+        if(ears.empty()) return false;
+        uint32_t v = ears.begin()->second;
+        ears.erase(ears.begin());
+        key[v] = -1;
+
+        m_Triangles.push_back({prev[v], v, next[v]});
+        next[prev[v]] = next[v];
+        prev[next[v]] = prev[v];
+        alive = next[v];
+        update(prev[v]);
+        update(next[v]);
+    }
+    m_Triangles.push_back({prev[alive], alive, next[alive]});
+    return true;
+}
+
+
+void CApproxTriangulation::flipEdges()
+{
+    auto edge = [](uint32_t a, uint32_t b) { return (uint64_t)min(a, b) << 32 | max(a, b); };
+    unordered_map<uint64_t, array<int, 2>> owners;
+    for(size_t t = 0; t < m_Triangles.size(); ++t)
+        for(size_t e = 0; e < 3; ++e){
+            auto it = owners.try_emplace(edge(m_Triangles[t][e], m_Triangles[t][(e + 1) % 3]), array<int, 2>{-1, -1}).first;
+            it->second[it->second[0] >= 0] = (int)t;
+        }
+
+    auto opposite = [&](int t, uint32_t a, uint32_t b) {
+        for(auto v : m_Triangles[t]) if(v != a && v != b) return v;
+        return a;
+    };
+    auto replace = [&](uint32_t a, uint32_t b, int from, int to) {
+        auto & pair = owners[edge(a, b)];
+        pair[pair[1] == from] = to;
+    };
+
+    // every flip shortens the weight, a flip may only enable flips of the four outer edges of its quadrilateral
+    vector<uint64_t> pending;
+    for(auto & [key, pair] : owners) if(pair[1] >= 0) pending.push_back(key);
+    while(!pending.empty()){
+        uint64_t key = pending.back();
+        pending.pop_back();
+        auto it = owners.find(key);
+        if(it == owners.end() || it->second[1] < 0) continue;
+
+        auto [t1, t2] = it->second;
+        uint32_t a = key >> 32, b = (uint32_t)key;
+        uint32_t c = opposite(t1, a, b), d = opposite(t2, a, b);
+        const CPoint & pa = m_Points[a], & pb = m_Points[b], & pc = m_Points[c], & pd = m_Points[d];
+        // the diagonals cross properly iff the quadrilateral is strictly convex
+        long long abc = CTriangulation::cross(pa, pb, pc), abd = CTriangulation::cross(pa, pb, pd);
+        long long cda = CTriangulation::cross(pc, pd, pa), cdb = CTriangulation::cross(pc, pd, pb);
+        bool convex = ((abc > 0 && abd < 0) || (abc < 0 && abd > 0)) && ((cda > 0 && cdb < 0) || (cda < 0 && cdb > 0));
+        if(!convex || length(c, d) >= length(a, b)) continue;
+
+        m_Triangles[t1] = {c, d, a};
+        m_Triangles[t2] = {c, d, b};
+        replace(b, c, t1, t2);
+        replace(a, d, t2, t1);
+        owners.erase(it);
+        owners[edge(c, d)] = {t1, t2};
+        for(auto e : {edge(a, c), edge(b, c), edge(a, d), edge(b, d)}) pending.push_back(e);
+    }
+}
+
+
+void CApproxTriangulation::bound()
+{
+    vector<double> candidates;
+    for(size_t i = 0; i < m_N; ++i)
+        for(size_t j = i + 2; j < m_N; ++j){
+            if(!i && j == m_N - 1) continue;
+            if(CTriangulation::inCone(m_Points[(i + m_N - 1) % m_N], m_Points[i], m_Points[(i + 1) % m_N], m_Points[j], m_Orientation)
+               && CTriangulation::inCone(m_Points[(j + m_N - 1) % m_N], m_Points[j], m_Points[(j + 1) % m_N], m_Points[i], m_Orientation))
+                candidates.push_back(length(i, j));
+        }
+
+    size_t diagonals = min(m_N - 3, candidates.size());
+    nth_element(candidates.begin(), candidates.begin() + diagonals, candidates.end());
+    m_LowerBound = accumulate(candidates.begin(), candidates.begin() + diagonals, m_Perimeter);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+#ifndef __PROGTEST__
+CProcessShard::CProcessShard(size_t slots)
+    : m_Slots(slots), m_Capacity(slots + 1), m_RingBytes((sizeof(sem_t) + m_Capacity * sizeof(uint32_t) + 4095) & ~(size_t)4095),
+      m_Size(m_RingBytes + slots * SLOT_BYTES)
+{
+    // the pages are only backed once touched
+    void * shm = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(shm == MAP_FAILED) throw runtime_error("cannot map the worker process memory");
+    m_Shm = (uint8_t*)shm;
+
+    sem_init(queued(), 1, 0);
+    for(size_t i = 0; i < m_Slots; ++i) sem_init(&slot(i)->m_Done, 1, 0);
+
+    pid_t parent = getpid();
+    if((m_Pid = fork()) < 0){
+        munmap(m_Shm, m_Size);
+        throw runtime_error("cannot fork a worker process");
+    }
+    if(!m_Pid){
+        // no parent, nobody to serve
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if(getppid() == parent) serve();
+        _exit(0);
+    }
+}
+
+
+CProcessShard::~CProcessShard() noexcept
+{
+    if(!m_Dead){
+        push(STOP);
+        waitpid(m_Pid, nullptr, 0);
+    }
+    sem_destroy(queued());
+    for(size_t i = 0; i < m_Slots; ++i) sem_destroy(&slot(i)->m_Done);
+    munmap(m_Shm, m_Size);
+}
+
+
+void CProcessShard::push(uint32_t slot)
+{
+    ring()[m_Head++ % m_Capacity] = slot;
+    sem_post(queued());
+}
+
+
+// Reaps the process if it has exited, called under m_Mtx
+bool CProcessShard::alive()
+{
+    if(!m_Dead && waitpid(m_Pid, nullptr, WNOHANG) == m_Pid) m_Dead = true;
+    return !m_Dead;
+}
+
+
+bool CProcessShard::solve(size_t index, SolverType type, const vector<CPolygon*> & problems)
+{
+    size_t bytes = sizeof(CSlot);
+    for(auto & p : problems) bytes += recordSize(p->m_Points.size());
+    if(index >= m_Slots || bytes > SLOT_BYTES) return false;
+
+    auto batch = slot(index);
+    batch->m_Type = type;
+    batch->m_Count = (uint32_t)problems.size();
+    auto pos = (uint8_t*)(batch + 1);
+    for(auto & p : problems){
+        auto record = (CRecord*)pos;
+        record->m_Size = p->m_Points.size();
+        memcpy((void*)(record + 1), p->m_Points.data(), record->m_Size * sizeof(CPoint));
+        pos += recordSize(record->m_Size);
+    }
+
+    {
+        lock_guard<mutex> lock(m_Mtx);
+        if(!alive()) return false;
+        push((uint32_t)index);
+    }
+
+    while(true){
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += chrono::nanoseconds(LIVENESS_CHECK).count();
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+
+        if(!sem_timedwait(&batch->m_Done, &deadline)) break;
+        if(errno == EINTR) continue;
+        lock_guard<mutex> lock(m_Mtx);
+        if(!alive()) return false;
+    }
+
+    pos = (uint8_t*)(batch + 1);
+    for(auto & p : problems){
+        auto record = (CRecord*)pos;
+        if(type == MIN) p->m_TriangMin = record->m_Min;
+        else memcpy((void*)&p->m_TriangCnt, &record->m_Cnt, sizeof(CBigInt));
+        pos += recordSize(record->m_Size);
+    }
+    return true;
+}
+
+
+// The loop of the worker process, the requests are taken in the ring order until STOP
+void CProcessShard::serve()
+{
+    for(size_t tail = 0;; ++tail){
+        while(sem_wait(queued()) && errno == EINTR);
+        uint32_t index = ring()[tail % m_Capacity];
+        if(index == STOP) return;
+
+        auto batch = slot(index);
+        auto pos = (uint8_t*)(batch + 1);
+        for(uint32_t i = 0; i < batch->m_Count; ++i){
+            auto record = (CRecord*)pos;
+            CTriangulation triangulation((const CPoint*)(record + 1), record->m_Size);
+            if(batch->m_Type == MIN) record->m_Min = triangulation.minWeight();
+            else{
+                CBigInt cnt = triangulation.count();
+                memcpy((void*)&record->m_Cnt, &cnt, sizeof(CBigInt));
+            }
+            pos += recordSize(record->m_Size);
+        }
+        sem_post(&batch->m_Done);
+    }
+}
+#endif /* __PROGTEST__ */
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+// The solvers are created by the provisioner once the first problem comes, a size class without problems takes no
+// progtest instance
+void COptimizer::initSolvers()
+{
+    for(size_t i = 0; i < m_SizeClasses; ++i){
+        m_Slots[MIN][i].m_Create = createProgtestMinSolver;
+        m_Slots[CNT][i].m_Type = CNT;
+        m_Slots[CNT][i].m_Create = createProgtestCntSolver;
+    }
+    m_Provisioner = thread(&COptimizer::provisionSolvers, this);
+}
+
+
+void COptimizer::workThread(size_t id)
+{
+    while(true)
+    {
+        auto solver = m_ToSolve.pop();
+        if(!solver) break;
+
+        auto begin = chrono::steady_clock::now();
+        TRACE("solve", 'B', solver->m_Type);
+        solveBatch(id, solver);
+        TRACE("solve", 'E', solver->m_Type);
+        m_Cost.observe(solver->m_Type, solver->m_Work, chrono::duration<double>(chrono::steady_clock::now() - begin).count());
+
+#ifndef __PROGTEST__
+        if(m_Store.isOpen()) m_Store.append(solver->m_Type, solver->m_Problems);
+#endif /* __PROGTEST__ */
+        // the released capacity is refilled right away, the scatter thread only hands the results to the companies
+        releaseSolver(solver);
+        m_Solved.push(solver);
+        dispatchPacks();
+    }
+}
+
+
+// Hands the solved batches to the companies, the workers released them already. A company is notified once per
+// batch, its submitter commits all the solved packs at the head of its queue on a single wakeup.
+void COptimizer::scatterResults()
+{
+    vector<size_t> completed;
+    while(auto solver = m_Solved.pop())
+    {
+        completed.clear();
+        for(auto & solved : solver->m_solved){
+            size_t id = solved.m_Pack->m_CompanyId;
+
+            // the pack may be submitted and deleted as soon as its last problem is accounted
+            if(solved.m_Pack->toBeSolved.fetch_sub(solved.m_Counter) == solved.m_Counter)
+                completed.push_back(id);
+        }
+        sort(completed.begin(), completed.end());
+        completed.erase(unique(completed.begin(), completed.end()), completed.end());
+        for(auto id : completed) m_Companies[id].m_Queue.notify();
+        delete solver;
+    }
+}
+
+
+// The progtest solver holds the same problems, it is the fallback if the worker process cannot take the batch.
+// A batch without a progtest solver, or one the progtest solver did not solve completely, is solved natively.
+void COptimizer::solveBatch(size_t worker, Solver * solver)
+{
+#ifndef __PROGTEST__
+    if(!m_Shards.empty()){
+        auto & shard = *m_Shards[worker % m_Shards.size()];
+        if(shard.solve(worker / m_Shards.size(), solver->m_Type, solver->m_Problems)) return;
+    }
+#endif /* __PROGTEST__ */
+    if(solver->m_Solver && withinBudget(*solver)){
+        if(solver->m_Solver->solve() >= solver->m_Problems.size()) return;
+        exhausted(solver->m_Type);
+    }
+    solveNative(solver->m_Type, solver->m_Problems);
+}
+
+
+void COptimizer::solveNative(SolverType type, const vector<CPolygon*> & problems)
+{
+    for(auto p : problems){
+        CTriangulation triangulation(p->m_Points);
+        if(type == MIN) p->m_TriangMin = triangulation.minWeight();
+        else p->m_TriangCnt = triangulation.count();
+    }
+}
+
+
+void COptimizer::problemReceiver (ACompanyWrapper * company, int id)
+{
+    while(true)
+    {
+        // an idle company blocked in waitForPack holds no slot
+        waitInFlight(company);
+        auto pack = company->m_Company->waitForPack();
+        if(pack) acquireInFlight(company);
+        auto packWrap = pack ? new AProblemPackWrapper(pack, id) : nullptr;
+        if(pack){
+            TRACE("pack received", 'i', id);
+            answerAtIntake(*company, packWrap);
+        }
+        bool solved = !pack || packWrap->isSolved();
+
+        company->m_Queue.push(packWrap);
+        if(!pack) break;
+        if(!solved) schedulePack(packWrap);
+    }
+}
+
+
+void COptimizer::problemSubmitter (ACompanyWrapper * company, [[maybe_unused]] int id)
+{
+    while(true)
+    {
+        auto solved = company->m_Queue.pop();
+        if(!solved) break;
+
+        company->m_Company->solvedPack(solved->m_Pack);
+        TRACE("pack committed", 'i', id);
+        delete solved;
+        releaseInFlight(company);
+    }
+}
+
+
+#ifndef __PROGTEST__
+// Coroutine counterpart of problemSubmitter, suspended while the head pack of the company is not solved
+CTask COptimizer::submitCoroutine (ACompanyWrapper * company)
+{
+    while(auto solved = co_await CSolvedAwaiter{company->m_Queue})
+    {
+        company->m_Company->solvedPack(solved->m_Pack);
+        TRACE("pack committed", 'i', solved->m_CompanyId);
+        delete solved;
+        releaseInFlight(company);
+    }
+    m_Executor.retire();
+}
+#endif /* __PROGTEST__ */
+
+
+// Called with the slot lock held, the spare (if any) becomes the open solver
+Solver * COptimizer::detachSolver(CSolverSlot & slot)
+{
+    auto full = slot.m_Solver;
+    slot.m_Solver = slot.m_Spare;
+    slot.m_Spare = nullptr;
+    return full;
+}
+
+
+// A progtest solver unless the kind is solved natively. The factory of a kind returning no solver or one without
+// capacity is exhausted, the kind is solved natively from then on. So is a kind whose budget is used up. The batches
+// shipped to the worker processes need no progtest solver.
+Solver * COptimizer::createSolver(const CSolverSlot & slot)
+{
+    AProgtestSolver solver;
+    if(!m_NativeSolvers && !m_Processes && !m_Exhausted[slot.m_Type]){
+        solver = slot.m_Create();
+        if(!solver || !solver->hasFreeCapacity()){
+            solver = nullptr;
+            exhausted(slot.m_Type);
+        }
+    }
+    auto res = new Solver(std::move(solver), slot.m_Type);
+    if(m_Budget && res->m_Solver){
+        lock_guard<mutex> lock(m_BudgetMtx);
+        res->m_Instance = m_Capacities[slot.m_Type].size();
+        m_Capacities[slot.m_Type].push_back(0);
+    }
+    return res;
+}
+
+
+// The library charges an instance its whole capacity. The capacity left in a solver sealed before it is full is
+// learned by padding the solver with a triangle, cheap to solve.
+void COptimizer::chargeBudget(Solver * solver)
+{
+    if(!m_Budget || !solver->m_Solver) return;
+    auto padding = make_shared<CPolygon>(vector<CPoint>{{0, 0}, {1, 0}, {0, 1}});
+    size_t capacity = solver->m_Problems.size();
+    while(capacity < m_Budget && solver->m_Solver->hasFreeCapacity() && solver->m_Solver->addPolygon(padding)) capacity++;
+
+    size_t total = 0;
+    {
+        lock_guard<mutex> lock(m_BudgetMtx);
+        auto & capacities = m_Capacities[solver->m_Type];
+        capacities[solver->m_Instance] = capacity;
+        total = accumulate(capacities.begin(), capacities.end(), size_t(0));
+    }
+    if(total >= m_Budget) exhausted(solver->m_Type);
+}
+
+
+// The instances created past the budget may fill in wrong results unnoticed. An instance is used only once all
+// instances of its kind created before it are sealed and leave a part of the budget to it, otherwise (e.g. another
+// size class holds an open instance) its batch is solved natively.
+bool COptimizer::withinBudget(const Solver & solver)
+{
+    if(!m_Budget) return true;
+    lock_guard<mutex> lock(m_BudgetMtx);
+    auto & capacities = m_Capacities[solver.m_Type];
+    size_t before = 0;
+    for(size_t i = 0; i < solver.m_Instance; ++i){
+        if(!capacities[i]) return false;
+        before += capacities[i];
+    }
+    return before < m_Budget;
+}
+
+
+// The results stay correct, the warning tells the budget of the progtest library did not suffice
+void COptimizer::exhausted(SolverType type)
+{
+    if(!m_Exhausted[type].exchange(true))
+        cerr << "COptimizer: the progtest " << (type == MIN ? "TriangMin" : "TriangCnt")
+             << " solvers are exhausted, the remaining problems are solved natively" << endl;
+}
+
+
+void COptimizer::provisionSolvers()
+{
+    while(auto slot = m_Provision.pop())
+    {
+        auto fresh = createSolver(*slot);
+        {
+            lock_guard<mutex> lock(slot->m_Mtx);
+            (slot->m_Solver ? slot->m_Spare : slot->m_Solver) = fresh;
+            slot->m_Requested = false;
+        }
+        slot->m_Cond.notify_all();
+    }
+}
+
+
+void COptimizer::fillSolver(AProblemPackWrapper * pack)
+{
+    // the wrapper may be submitted and deleted once its last problem is sealed, the problems stay alive
+    AProblemPack problems = pack->m_Pack;
+    CProblemRefs unsolved[END] = {std::move(pack->m_Unsolved[MIN]), std::move(pack->m_Unsolved[CNT])};
+
+    for(auto type : {MIN, CNT})
+        if(!unsolved[type].empty()) fillSlots(type, pack, unsolved[type]);
+}
+
+
+// Answers the problems that need no solver on the receiving thread: triangles, the result store hits and
+// the approximated TriangMin problems. A pack answered completely is solved before it is queued, it skips
+// the scheduling and the workers.
+void COptimizer::answerAtIntake(const ACompanyWrapper & company, AProblemPackWrapper * pack)
+{
+    for(auto type : {MIN, CNT})
+        for(auto & p : type == MIN ? pack->m_Pack->m_ProblemsMin : pack->m_Pack->m_ProblemsCnt){
+            if(p->m_Points.size() == 3){
+                CTriangulation triangle(p->m_Points);
+                if(type == MIN) p->m_TriangMin = triangle.minWeight();
+                else p->m_TriangCnt = triangle.count();
+            }
+            else if(type == MIN && company.m_Config.m_ApproxMin) approximateMin(company.m_Config, *p);
+#ifndef __PROGTEST__
+            else if(m_Store.isOpen() && m_Store.lookup(type, *p)) continue;
+#endif /* __PROGTEST__ */
+            else pack->m_Unsolved[type].push_back(&p);
+        }
+
+    // the pack is not shared yet
+    pack->toBeSolved = pack->m_Unsolved[MIN].size() + pack->m_Unsolved[CNT].size();
+}
+
+
+void COptimizer::approximateMin(const CCompanyConfig & config, CPolygon & p)
+{
+    CApproxTriangulation approx(p.m_Points);
+    p.m_TriangMin = approx.weight();
+    if(config.m_ApproxGap) config.m_ApproxGap(p, approx.gap());
+}
+
+
+// Polygons of similar size share a solver, thus the batches of a class take similar time
+size_t COptimizer::sizeClass(const APolygon & p) const
+{
+    size_t bits = 0;
+    for(size_t n = p->m_Points.size(); n; n >>= 1) bits++;
+    return min(max<size_t>(bits, 3) - 3, m_SizeClasses - 1);
+}
+
+
+void COptimizer::fillSlots(SolverType type, AProblemPackWrapper * pack, const CProblemRefs & problems)
+{
+    if(m_SizeClasses == 1){
+        fillSlot(m_Slots[type][0], pack, problems);
+        return;
+    }
+
+    CProblemRefs classes[SIZE_CLASSES];
+    for(auto p : problems) classes[sizeClass(*p)].push_back(p);
+    for(size_t i = 0; i < m_SizeClasses; ++i)
+        if(!classes[i].empty()) fillSlot(m_Slots[type][i], pack, classes[i]);
+}
+
+
+// The problems are added in runs, one lock acquisition per solver the pack spans. The thread that fills the solver
+// up (or reaches the predicted batch cost) swaps in the spare and seals the full one after unlocking. A problem
+// predicted to reach the batch cost alone seals the solver before it is added, thus it gets a solver on its own.
+// A problem the progtest solver rejects goes to the next solver, a solver that rejected all is dropped.
+// The slot gets its first solver with its first problem.
+void COptimizer::fillSlot(CSolverSlot & slot, AProblemPackWrapper * pack, const CProblemRefs & problems)
+{
+    for(size_t i = 0; i < problems.size();)
+    {
+        Solver * full = nullptr;
+        {
+            unique_lock<mutex> lock(slot.m_Mtx);
+            if(!slot.m_Solver && !slot.m_Requested){
+                slot.m_Requested = true;
+                m_Provision.push(&slot);
+            }
+            slot.m_Cond.wait(lock, [&slot] { return slot.m_Solver; });
+
+            auto solver = slot.m_Solver;
+            if(solver->m_solved.empty() && !slot.m_Spare && !slot.m_Requested){
+                slot.m_Requested = true;
+                m_Provision.push(&slot);
+            }
+
+            auto & counter = solver->m_solved.emplace_back(pack);
+            while(i < problems.size()){
+                const APolygon & problem = *problems[i];
+                double work = CCostModel::work(problem);
+                if(solver->m_Work && m_BatchCost && m_Cost.predict(slot.m_Type, work) >= m_BatchCost){
+                    full = detachSolver(slot);
+                    break;
+                }
+                if(solver->m_Solver && !solver->m_Solver->addPolygon(problem)){
+                    full = detachSolver(slot);
+                    break;
+                }
+                i++;
+                solver->m_Work += work;
+                solver->m_Problems.push_back(problem.get());
+                counter.m_Counter++;
+                TRACE("problem added", 'i', pack->m_CompanyId);
+
+                if(!solver->hasFreeCapacity() || (m_BatchCost && m_Cost.predict(slot.m_Type, solver->m_Work) >= m_BatchCost)){
+                    full = detachSolver(slot);
+                    break;
+                }
+            }
+            // a counter without problems would account the pack after it may be gone
+            if(!counter.m_Counter) solver->m_solved.pop_back();
+        }
+        if(full && full->m_solved.empty()) delete full;
+        else if(full) sealSolver(full);
+    }
+}
+
+
+// Pack costs are the number of problems, weighted by the company share
+void COptimizer::schedulePack(AProblemPackWrapper * pack)
+{
+    {
+        lock_guard<mutex> lock(m_SchedMtx);
+        auto & company = m_Companies[pack->m_CompanyId];
+        double cost = (double)pack->toBeSolved / company.m_Config.m_Weight;
+
+        pack->m_FinishTag = company.m_VirtualFinish = max(m_VirtualTime, company.m_VirtualFinish) + cost;
+        if(company.m_Pending.empty()) m_Backlogged.emplace(pack->m_FinishTag, pack->m_CompanyId);
+        company.m_Pending.push(pack);
+    }
+    dispatchPacks();
+}
+
+
+// Called with m_SchedMtx held, the limits do not apply while draining in stop()
+AProblemPackWrapper * COptimizer::nextPack()
+{
+    if(!m_Draining && m_SealedSolvers >= m_MaxSealed) return nullptr;
+
+    for(auto it = m_Backlogged.begin(); it != m_Backlogged.end(); ++it){
+        auto & company = m_Companies[it->second];
+        if(!m_Draining && company.m_Config.m_Quota && company.m_Sealed >= company.m_Config.m_Quota) continue;
+
+        auto pack = company.m_Pending.front(); company.m_Pending.pop();
+        m_VirtualTime = it->first;
+        m_Backlogged.erase(it);
+        if(!company.m_Pending.empty()) m_Backlogged.emplace(company.m_Pending.front()->m_FinishTag, pack->m_CompanyId);
+        return pack;
+    }
+    return nullptr;
+}
+
+
+void COptimizer::dispatchPacks()
+{
+    while(true)
+    {
+        AProblemPackWrapper * pack;
+        {
+            lock_guard<mutex> lock(m_SchedMtx);
+            if(!(pack = nextPack())) break;
+            m_Dispatching++;
+        }
+
+        fillSolver(pack);
+
+        {
+            lock_guard<mutex> lock(m_SchedMtx);
+            m_Dispatching--;
+        }
+        m_SchedCond.notify_all();
+    }
+    unblockIntake();
+}
+
+
+// Dispatches the whole backlog and waits for the concurrent dispatches, the solvers may be finalized afterwards
+void COptimizer::drainPacks()
+{
+    {
+        lock_guard<mutex> lock(m_SchedMtx);
+        m_Draining = true;
+    }
+    dispatchPacks();
+
+    unique_lock<mutex> lock(m_SchedMtx);
+    m_SchedCond.wait(lock, [this] { return m_Backlogged.empty() && !m_Dispatching; });
+}
+
+
+void COptimizer::sealSolver(Solver * solver)
+{
+    chargeBudget(solver);
+    {
+        lock_guard<mutex> lock(m_SchedMtx);
+        m_SealedSolvers++;
+        for(auto & solved : solver->m_solved){
+            m_Companies[solved.m_Pack->m_CompanyId].m_Sealed += solved.m_Counter;
+            solver->m_Deadline = min(solver->m_Deadline, solved.m_Pack->m_Arrival);
+        }
+    }
+    TRACE("solver sealed", 'i', solver->m_solved.size());
+    m_ToSolve.push(solver);
+}
+
+
+// Must precede the toBeSolved updates, the packs are alive until then
+void COptimizer::releaseSolver(const Solver * solver)
+{
+    lock_guard<mutex> lock(m_SchedMtx);
+    m_SealedSolvers--;
+    for(auto & solved : solver->m_solved)
+        m_Companies[solved.m_Pack->m_CompanyId].m_Sealed -= solved.m_Counter;
+}
+
+
+// Seals the open solvers holding the oldest pack, its company commits in order and waits for it. Only these lose
+// their unused capacity, a later stall seals the solvers of the next oldest pack.
+void COptimizer::flushSolvers()
+{
+    const AProblemPackWrapper * oldest = nullptr;
+    for(auto & slots : m_Slots)
+        for(size_t i = 0; i < m_SizeClasses; ++i){
+            lock_guard<mutex> lock(slots[i].m_Mtx);
+            if(!slots[i].m_Solver) continue;
+            for(auto & solved : slots[i].m_Solver->m_solved)
+                if(!oldest || solved.m_Pack->m_Arrival < oldest->m_Arrival) oldest = solved.m_Pack;
+        }
+    if(!oldest) return;
+
+    // the pack is only compared, it may be solved meanwhile by a solver another thread sealed
+    for(auto & slots : m_Slots)
+        for(size_t i = 0; i < m_SizeClasses; ++i){
+            auto & slot = slots[i];
+            Solver * full = nullptr;
+            {
+                lock_guard<mutex> lock(slot.m_Mtx);
+                if(!slot.m_Solver) continue;
+                auto & solved = slot.m_Solver->m_solved;
+                if(any_of(solved.begin(), solved.end(), [oldest](auto & s) { return s.m_Pack == oldest; }))
+                    full = detachSolver(slot);
+            }
+            if(full) sealSolver(full);
+        }
+}
+
+
+// No sealed solver and no dispatch in progress, the unsolved packs in flight wait in the open solvers
+bool COptimizer::pipelineStalled()
+{
+    lock_guard<mutex> lock(m_SchedMtx);
+    return !m_SealedSolvers && !m_Dispatching && m_Backlogged.empty();
+}
+
+
+// Every dispatch ends here, after a worker released a solver or a receiver scheduled a pack. Those are the only
+// events that stall the pipeline, the receivers blocked at the in-flight limit then get the open solvers sealed.
+void COptimizer::unblockIntake()
+{
+    {
+        lock_guard<mutex> lock(m_InFlightMtx);
+        if(!m_Throttled) return;
+    }
+    if(pipelineStalled()) flushSolvers();
+}
+
+
+// Called with m_InFlightMtx held
+bool COptimizer::atInFlightLimit(const ACompanyWrapper * company) const
+{
+    auto limit = company->m_Config.m_MaxInFlight;
+    return (limit && company->m_InFlight >= limit) || (m_MaxInFlight && m_InFlight >= m_MaxInFlight);
+}
+
+
+// The open solvers are only sealed once full, nothing would free a slot if the intake stopped filling them. A receiver
+// about to block seals them if the pipeline is stalled, later stalls are caught by unblockIntake.
+void COptimizer::awaitInFlight(ACompanyWrapper * company, unique_lock<mutex> & lock)
+{
+    if(!atInFlightLimit(company)) return;
+
+    m_Throttled++;
+    lock.unlock();
+    if(pipelineStalled()) flushSolvers();
+    lock.lock();
+    company->m_InFlightCond.wait(lock, [this, company] { return !atInFlightLimit(company); });
+    m_Throttled--;
+}
+
+
+// Blocks the receiver while the company or the whole optimizer is at the limit, takes no slot
+void COptimizer::waitInFlight(ACompanyWrapper * company)
+{
+    unique_lock<mutex> lock(m_InFlightMtx);
+    awaitInFlight(company, lock);
+}
+
+
+// Counts a received pack, another company may have taken the last slot since waitInFlight
+void COptimizer::acquireInFlight(ACompanyWrapper * company)
+{
+    unique_lock<mutex> lock(m_InFlightMtx);
+    awaitInFlight(company, lock);
+    company->m_InFlight++;
+    m_InFlight++;
+}
+
+
+// Only a release at the optimizer wide limit may unblock the other companies
+void COptimizer::releaseInFlight(ACompanyWrapper * company)
+{
+    bool wasFull;
+    {
+        lock_guard<mutex> lock(m_InFlightMtx);
+        wasFull = m_MaxInFlight && m_InFlight == m_MaxInFlight;
+        company->m_InFlight--;
+        m_InFlight--;
+    }
+    if(!wasFull){
+        company->m_InFlightCond.notify_all();
+        return;
+    }
+    for(auto & other : m_Companies) other.m_InFlightCond.notify_all();
+}
+
+
+// No dispatch is in progress and the provisioner has delivered all requested solvers, a slot without a solver got
+// no problem
+void COptimizer::finalizeSolvers()
+{
+    m_Provision.push(nullptr);
+    m_Provisioner.join();
+
+    for(auto & slots : m_Slots)
+        for(size_t i = 0; i < m_SizeClasses; ++i){
+            auto & slot = slots[i];
+            lock_guard<mutex> lock(slot.m_Mtx);
+            if(!slot.m_Solver || slot.m_Solver->m_solved.empty()) delete slot.m_Solver;
+            else sealSolver(slot.m_Solver);
+            delete slot.m_Spare;
+            slot.m_Solver = slot.m_Spare = nullptr;
+        }
+}
+
+
+// Logical CPUs available to the process grouped by the physical core they belong to
+vector<vector<int>> COptimizer::physicalCores()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed)) return {};
+
+    map<pair<int, int>, vector<int>> cores;
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu){
+        if(!CPU_ISSET(cpu, &allowed)) continue;
+
+        string topology = "/sys/devices/system/cpu/cpu" + to_string(cpu) + "/topology/";
+        int package = 0, core = cpu;
+        readTopologyId(topology + "physical_package_id", package);
+        readTopologyId(topology + "core_id", core);
+        cores[{package, core}].push_back(cpu);
+    }
+
+    vector<vector<int>> res;
+    for(auto & [id, cpus] : cores) res.push_back(std::move(cpus));
+    return res;
+}
+
+
+// A missing or unreadable file keeps the default id
+void COptimizer::readTopologyId(const string & fileName, int & id)
+{
+    FILE * file = fopen(fileName.c_str(), "r");
+    if(!file) return;
+    int value;
+    if(fscanf(file, "%d", &value) == 1) id = value;
+    fclose(file);
+}
+
+
+// Best effort, a thread that cannot be pinned keeps floating
+void COptimizer::pinThread(thread & th, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(th.native_handle(), sizeof(set), &set);
+}
+
+
+void COptimizer::placeThreads(const CPlacementPolicy & placement)
+{
+    auto cores = physicalCores();
+    if(cores.empty()) return;
+
+    // The first solverCores physical cores belong to the workers, intake runs on the rest if isolated
+    size_t solverCores = cores.size();
+    if(placement.m_IsolateIntake && cores.size() > 1)
+        solverCores = min(cores.size() - 1, max<size_t>(m_WorkThreads.size(), 1));
+
+    if(placement.m_PinWorkers)
+        for(size_t i = 0; i < m_WorkThreads.size(); ++i)
+            pinThread(m_WorkThreads[i], cores[i % solverCores].front());
+
+    if(!placement.m_CoLocateCompany && !placement.m_IsolateIntake) return;
+
+    vector<int> intakeCpus;
+    for(size_t i = placement.m_IsolateIntake ? solverCores : 0; i < cores.size(); ++i)
+        intakeCpus.insert(intakeCpus.end(), cores[i].begin(), cores[i].end());
+
+    // No spare physical core, fall back to the hyper-thread siblings of the solver cores
+    if(intakeCpus.empty())
+        for(auto & core : cores)
+            intakeCpus.insert(intakeCpus.end(), core.begin() + 1, core.end());
+    if(intakeCpus.empty()) return;
+
+    for(size_t i = 0; i < m_Companies.size(); ++i){
+        size_t receiverCpu = placement.m_CoLocateCompany ? i : 2 * i;
+        size_t submitterCpu = placement.m_CoLocateCompany ? i : 2 * i + 1;
+        pinThread(m_Receivers[i], intakeCpus[receiverCpu % intakeCpus.size()]);
+        if(i < m_Submitters.size()) pinThread(m_Submitters[i], intakeCpus[submitterCpu % intakeCpus.size()]);
+    }
+}
+
+
+void COptimizer::start ( int threadCount, const CPlacementPolicy & placement )
+{
+    // forked before any optimizer thread exists
+#ifndef __PROGTEST__
+    size_t slots = (max(threadCount, 1) + m_Processes - 1) / max<size_t>(m_Processes, 1);
+    for(size_t i = 0; i < m_Processes; ++i) m_Shards.push_back(make_unique<CProcessShard>(slots));
+#endif /* __PROGTEST__ */
+
+#ifndef __PROGTEST__
+    if(!m_StoreFile.empty()) m_Store.open(m_StoreFile);
+#endif /* __PROGTEST__ */
+    initSolvers();
+    m_MaxSealed = 2 * max(threadCount, 1);
+
+#ifndef __PROGTEST__
+    m_Executor.start(m_ExecutorThreads);
+#endif /* __PROGTEST__ */
+
+    for(size_t i = 0; i < m_Companies.size(); ++i){
+        m_Receivers.emplace_back(&COptimizer::problemReceiver, this, &m_Companies[i], i);
+
+#ifndef __PROGTEST__
+        if(m_ExecutorThreads){
+            m_Companies[i].m_Queue.setResumer([this] (coroutine_handle<> h) { m_Executor.schedule(h); });
+            m_Executor.spawn(submitCoroutine(&m_Companies[i]));
+            continue;
+        }
+#endif /* __PROGTEST__ */
+        m_Submitters.emplace_back(&COptimizer::problemSubmitter, this, &m_Companies[i], i);
+    }
+
+    m_Scatterer = thread(&COptimizer::scatterResults, this);
+    for (int i = 0; i < threadCount; ++i)
+        m_WorkThreads.emplace_back(&COptimizer::workThread, this, i);
+
+    placeThreads(placement);
+}
+
+
+void COptimizer::stop ()
+{
+    for(auto & th : m_Receivers) th.join();
+    drainPacks();
+    finalizeSolvers();
+    for(size_t i = 0; i < m_WorkThreads.size(); ++i) m_ToSolve.push(nullptr);
+    for(auto & th : m_WorkThreads) th.join();
+    m_Solved.push(nullptr);
+    m_Scatterer.join();
+#ifndef __PROGTEST__
+    m_Shards.clear();
+#endif /* __PROGTEST__ */
+    for(auto & th : m_Submitters) th.join();
+#ifndef __PROGTEST__
+    m_Executor.stop();
+#endif /* __PROGTEST__ */
+}
+
+
+// Caps the packs in flight over all companies, 0 = unlimited. Must be set before start.
+void COptimizer::setMaxInFlight ( size_t packs )
+{
+    m_MaxInFlight = packs;
+}
+
+
+#ifndef __PROGTEST__
+/**
+ * Replaces the per company submitter threads by coroutines resumed on executorThreads threads, 0 = threads.
+ * The receivers stay threads, CCompany::waitForPack blocks. Must be set before start. Not available in Progtest.
+ */
+void COptimizer::useCoroutinePipeline ( size_t executorThreads )
+{
+    m_ExecutorThreads = executorThreads;
+}
+#endif /* __PROGTEST__ */
+
+
+/**
+ * Groups the problems into solvers by polygon size (4 classes by the power of two of the vertex count) and seals
+ * a solver once its predicted solve time reaches batchMillis, a polygon predicted to take longer gets a solver on its own.
+ * The prediction is calibrated from the observed solve times. 0 = off. Must be set before start.
+ * Both the split and the early sealing leave solver capacity unused, the progtest library budget may not suffice.
+ * The solvers of a class are created once the class gets its first problem.
+ */
+void COptimizer::useSizeClasses ( double batchMillis )
+{
+    m_SizeClasses = batchMillis > 0 ? SIZE_CLASSES : 1;
+    m_BatchCost = batchMillis / 1000;
+}
+
+
+#ifndef __PROGTEST__
+/**
+ * Answers the problems solved by the previous runs from the store file (created if missing) and appends the newly
+ * solved ones, the stored problems do not consume solver capacity. Empty = off. The file is loaded by start.
+ * Not available in Progtest.
+ */
+void COptimizer::useResultStore ( const string & fileName )
+{
+    m_StoreFile = fileName;
+}
+#endif /* __PROGTEST__ */
+
+
+#ifndef __PROGTEST__
+/**
+ * Solves the sealed batches in processes forked by start instead of the work threads, which only ship the batches
+ * and scatter the results. The processes run CTriangulation, thus the batches get no progtest solver, a batch larger
+ * than the shared slot or left by a crashed process is solved natively in this process. 0 = off. Must be set before
+ * start. Not available in Progtest.
+ */
+void COptimizer::useWorkerProcesses ( size_t processes )
+{
+    m_Processes = processes;
+}
+#endif /* __PROGTEST__ */
+
+
+/**
+ * Solves all batches by CTriangulation on the work threads (or the worker processes), no progtest solver is created.
+ * Meant for the runs beyond the budget of the progtest library, e.g. offline jobs. Without it the kinds whose progtest
+ * factory is exhausted are solved natively as well. Must be set before start.
+ */
+void COptimizer::useNativeSolvers ( bool native )
+{
+    m_NativeSolvers = native;
+}
+
+
+/**
+ * The total capacity of the progtest instances of a kind, M of progtest_solver.h (100 for the delivered library).
+ * The instances created past it may fill in wrong results unnoticed, the problems beyond the budget are solved
+ * natively instead. 0 = unknown, only a missing solver, one without capacity or a failed solve are detected.
+ * Must be set before start.
+ */
+void COptimizer::useSolverBudget ( size_t problems )
+{
+    m_Budget = problems;
+}
+
+
+/**
+ * Memoizes the sub-chain DP values of CTriangulation across problems, up to entries per kind, 0 = off. Only the
+ * batches solved natively use it (see useNativeSolvers and useWorkerProcesses). The memo is per process: the worker
+ * processes inherit the setting and each memoizes the batches it solves. Must be set before start.
+ */
+void COptimizer::useChainMemo ( size_t entries )
+{
+    CTriangulation::useChainMemo(entries);
+}
+
+
+/**
+ * Registers a company. Under contention the solver capacity is shared in the ratio of the company weights,
+ * a non-zero quota additionally caps the number of company problems in the sealed solvers. With m_ApproxMin the
+ * TriangMin problems of the company are approximated at intake and never reach the solvers.
+ */
+void COptimizer::addCompany ( ACompany company, const CCompanyConfig & config )
+{
+    if(!config.m_Weight)
+        throw std::invalid_argument("addCompany: zero company weight");
+
+    std::function<bool(queue<AProblemPackWrapper*> & q)> isFirstSolved =
+            [] (queue<AProblemPackWrapper*> & q) {return !q.front() || !q.front()->toBeSolved;};
+
+    m_Companies.emplace_back(std::move(company), isFirstSolved, config);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+// the tools in this directory include the solution with SOLUTION_NO_MAIN defined
+#if !defined(__PROGTEST__) && !defined(SOLUTION_NO_MAIN)
+int main ()
+{
+  if ( checkSampleAlgorithms ( COptimizer::checkAlgorithmMin, COptimizer::checkAlgorithmCnt ) )
+    throw std::logic_error ( "checkAlgorithm results differ from the sample data" );
+
   COptimizer optimizer;
   ACompanyTest  company = std::make_shared<CCompanyTest> ();
   ACompanyTest  company2 = std::make_shared<CCompanyTest> ();
 
   optimizer . addCompany ( company );
   optimizer . addCompany ( company2 );
+  optimizer . useSolverBudget ( COptimizer::DELIVERED_BUDGET );
 
   optimizer . start (10);
   optimizer . stop  ();
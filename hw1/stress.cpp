@@ -0,0 +1,292 @@
+// Concurrency stress and scalability check of COptimizer. Many synthetic companies deliver packs of small random
+// star-shaped polygons (some packs empty, some triangles), every company checks that its packs come back in the
+// delivery order with the results of the native algorithms. The workload is repeated for 1, 2, 4, ... threads:
+//   ./stress [-c companies] [-p packs] [-t maxThreads] [-x executorThreads] [-f] [-m memoEntries] [-l]
+//            [-w processes] [-r store] [-s seed]
+// -f randomizes the company configurations (weights, quotas, in-flight limits, approximated TriangMin) and enables
+// the size classes. An approximated weight must lie between the exact one and its lower bound.
+// -m turns the sub-chain memo (COptimizer::useChainMemo) on. Most polygons are then variants of the previous one
+// sharing its chains, the results computed upfront with the memo off must match.
+// The batches are solved natively (COptimizer::useNativeSolvers), the delivered progtest library caps a process at
+// about 100 problems. -l uses the library solvers within that budget (COptimizer::useSolverBudget), the rest is
+// solved natively. Every thread count runs in its own forked process with a fresh library budget and memo.
+// -w solves the batches in worker processes (COptimizer::useWorkerProcesses). -r keeps the results in a store
+// (COptimizer::useResultStore), the file is removed first, the run with 1 thread fills it and the later runs answer
+// most problems from it at intake. Built with -fsanitize=thread (the stress_tsan target), the runs double as a race
+// detector.
+#include <random>
+#include <sys/wait.h>
+
+#define SOLUTION_NO_MAIN
+#include "solution.cpp"
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+struct CStressOptions
+{
+    size_t m_Companies = 1000;
+    size_t m_Packs = 10;
+    size_t m_MaxThreads = max(1u, thread::hardware_concurrency());
+    size_t m_ExecutorThreads = 0;
+    bool m_Features = false;
+    size_t m_MemoEntries = 0;
+    bool m_Library = false;
+    size_t m_Processes = 0;
+    string m_Store;
+    uint64_t m_Seed = 1;
+};
+
+static constexpr size_t MAX_PROBLEMS = 4;  // per kind and pack
+static constexpr size_t MAX_POINTS = 12;
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+/**
+ * Delivers pregenerated packs and verifies the returned ones against the results computed upfront. The receiver
+ * and the submitter only touch their own counters, the results are read back through the optimizer's synchronization.
+ */
+class CStressCompany : public CCompany
+{
+public:
+    CStressCompany(mt19937_64 & rng, size_t packs, bool related);
+
+    AProblemPack waitForPack() override;
+    void solvedPack(AProblemPack pack) override;
+
+    // the TriangMin problems are approximated, the gaps come from CCompanyConfig::m_ApproxGap
+    void approximate() { m_Approx = true; }
+    void approximated(const CPolygon & polygon, double gap);
+
+    // all packs returned in order with the expected results
+    [[nodiscard]] bool verified() const { return m_Returned == m_Packs.size() && !m_Errors; }
+    [[nodiscard]] size_t problems() const { return m_Problems; }
+private:
+    struct CExpected
+    {
+        AProblemPack m_Pack;
+        vector<double> m_Min;
+        vector<CBigInt> m_Cnt;
+        vector<double> m_Gap;    // of the approximated problems, NaN = not reported
+    };
+
+    static APolygon randomPolygon(mt19937_64 & rng);
+    static APolygon variant(mt19937_64 & rng, const CPolygon & polygon);
+
+    vector<CExpected> m_Packs;
+    size_t m_Problems = 0;
+    size_t m_Next = 0;
+    size_t m_Returned = 0;
+    size_t m_Errors = 0;
+    bool m_Approx = false;
+};
+
+
+CStressCompany::CStressCompany(mt19937_64 & rng, size_t packs, bool related)
+{
+    uniform_int_distribution<size_t> count(0, MAX_PROBLEMS);
+    APolygon last;
+    auto next = [&] { return last = related && last && rng() % 4 ? variant(rng, *last) : randomPolygon(rng); };
+
+    for(size_t i = 0; i < packs; ++i){
+        auto & expected = m_Packs.emplace_back();
+        expected.m_Pack = make_shared<CProblemPack>();
+
+        for(size_t j = count(rng); j--;){
+            auto p = next();
+            expected.m_Min.push_back(CTriangulation(p->m_Points).minWeight());
+            expected.m_Pack->addMin(std::move(p));
+        }
+        for(size_t j = count(rng); j--;){
+            auto p = next();
+            expected.m_Cnt.push_back(CTriangulation(p->m_Points).count());
+            expected.m_Pack->addCnt(std::move(p));
+        }
+        expected.m_Gap.assign(expected.m_Min.size(), NAN);
+        m_Problems += expected.m_Min.size() + expected.m_Cnt.size();
+    }
+}
+
+
+// Vertices at increasing angles around the origin, the polygon is simple and the points are distinct
+APolygon CStressCompany::randomPolygon(mt19937_64 & rng)
+{
+    size_t n = uniform_int_distribution<size_t>(3, MAX_POINTS)(rng);
+    uniform_real_distribution<double> jitter(0, 0.5), radius(1000, 100000);
+
+    vector<CPoint> points;
+    for(size_t i = 0; i < n; ++i){
+        double angle = 2 * M_PI * (i + jitter(rng)) / n, r = radius(rng);
+        points.emplace_back((int)lround(r * cos(angle)), (int)lround(r * sin(angle)));
+    }
+    return make_shared<CPolygon>(std::move(points));
+}
+
+
+// Starts at another vertex and moves one vertex along its ray from the origin, the angular order and thus the
+// simplicity is kept. The chains avoiding the moved vertex are shared with the original.
+APolygon CStressCompany::variant(mt19937_64 & rng, const CPolygon & polygon)
+{
+    vector<CPoint> points = polygon.m_Points;
+    rotate(points.begin(), points.begin() + rng() % points.size(), points.end());
+
+    auto & moved = points[rng() % points.size()];
+    double scale = uniform_real_distribution<double>(0.5, 1.5)(rng);
+    moved = CPoint((int)lround(moved.m_X * scale), (int)lround(moved.m_Y * scale));
+    return make_shared<CPolygon>(std::move(points));
+}
+
+
+AProblemPack CStressCompany::waitForPack()
+{
+    return m_Next < m_Packs.size() ? m_Packs[m_Next++].m_Pack : nullptr;
+}
+
+
+// Called at intake of the pack returned last, on the receiving thread. The submitter reads the gap after the pack
+// passed through the optimizer's queue.
+void CStressCompany::approximated(const CPolygon & polygon, double gap)
+{
+    auto & expected = m_Packs[m_Next - 1];
+    auto & problems = expected.m_Pack->m_ProblemsMin;
+    for(size_t i = 0; i < problems.size(); ++i)
+        if(problems[i].get() == &polygon) expected.m_Gap[i] = gap;
+}
+
+
+void CStressCompany::solvedPack(AProblemPack pack)
+{
+    if(m_Returned >= m_Packs.size() || m_Packs[m_Returned].m_Pack != pack){
+        m_Errors++;
+        return;
+    }
+
+    auto & expected = m_Packs[m_Returned++];
+    for(size_t i = 0; i < expected.m_Min.size(); ++i){
+        double weight = pack->m_ProblemsMin[i]->m_TriangMin, exact = expected.m_Min[i], tolerance = 1e-6 * exact;
+        // the triangles are answered exactly, the others satisfy weight >= exact >= lower bound = weight / (1 + gap)
+        if(m_Approx && pack->m_ProblemsMin[i]->m_Points.size() > 3){
+            double gap = expected.m_Gap[i];
+            if(isnan(gap) || weight < exact - tolerance || weight / (1 + gap) > exact + tolerance) m_Errors++;
+        }
+        else if(fabs(weight - exact) > tolerance) m_Errors++;
+    }
+    for(size_t i = 0; i < expected.m_Cnt.size(); ++i)
+        if(pack->m_ProblemsCnt[i]->m_TriangCnt != expected.m_Cnt[i]) m_Errors++;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+// Runs the whole workload with threads workers, returns the wall time in ms or a negative value on a failed check
+static double run(const CStressOptions & options, size_t threads)
+{
+    mt19937_64 rng(options.m_Seed);
+    vector<shared_ptr<CStressCompany>> companies;
+    COptimizer optimizer;
+
+    for(size_t i = 0; i < options.m_Companies; ++i){
+        companies.push_back(make_shared<CStressCompany>(rng, options.m_Packs, options.m_MemoEntries > 0));
+
+        CCompanyConfig config;
+        if(options.m_Features){
+            config.m_Weight = 1 + rng() % 3;
+            config.m_Quota = rng() % 2 ? 1 + rng() % 8 : 0;
+            config.m_MaxInFlight = rng() % 2 ? 1 + rng() % 4 : 0;
+            if(rng() % 4 == 0){
+                auto company = companies.back().get();
+                company->approximate();
+                config.m_ApproxMin = true;
+                config.m_ApproxGap = [company](const CPolygon & polygon, double gap) { company->approximated(polygon, gap); };
+            }
+        }
+        optimizer.addCompany(companies.back(), config);
+    }
+    if(options.m_Features) optimizer.useSizeClasses(1);
+    optimizer.useNativeSolvers(!options.m_Library);
+    if(options.m_Library) optimizer.useSolverBudget(COptimizer::DELIVERED_BUDGET);
+    // the expected results are computed already, without the memo
+    optimizer.useChainMemo(options.m_MemoEntries);
+    optimizer.useCoroutinePipeline(options.m_ExecutorThreads);
+    optimizer.useWorkerProcesses(options.m_Processes);
+    optimizer.useResultStore(options.m_Store);
+
+    auto begin = chrono::steady_clock::now();
+    optimizer.start((int)threads);
+    optimizer.stop();
+    double elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+
+    size_t failed = count_if(companies.begin(), companies.end(), [](auto & c) { return !c->verified(); });
+    if(failed) cerr << failed << " companies with misordered or wrong results (" << threads << " threads)" << endl;
+    return failed ? -1 : elapsed;
+}
+
+
+// Forks the run, the child reports its result through a pipe
+static double runIsolated(const CStressOptions & options, size_t threads)
+{
+    int fds[2];
+    if(pipe(fds)) return -1;
+
+    pid_t pid = fork();
+    if(!pid){
+        close(fds[0]);
+        double res = run(options, threads);
+        bool written = write(fds[1], &res, sizeof(res)) == sizeof(res);
+        _exit(written ? 0 : 1);
+    }
+    close(fds[1]);
+
+    double res = -1;
+    int status = 0;
+    if(pid < 0 || read(fds[0], &res, sizeof(res)) != sizeof(res)) res = -1;
+    close(fds[0]);
+    if(pid > 0) waitpid(pid, &status, 0);
+    return WIFEXITED(status) && !WEXITSTATUS(status) ? res : -1;
+}
+
+
+int main(int argc, char * argv[])
+{
+    CStressOptions options;
+    int opt;
+    while((opt = getopt(argc, argv, "c:p:t:x:fm:lw:r:s:")) != -1){
+        switch(opt){
+            case 'c': options.m_Companies = max(1, atoi(optarg)); break;
+            case 'p': options.m_Packs = max(1, atoi(optarg)); break;
+            case 't': options.m_MaxThreads = max(1, atoi(optarg)); break;
+            case 'x': options.m_ExecutorThreads = max(0, atoi(optarg)); break;
+            case 'f': options.m_Features = true; break;
+            case 'm': options.m_MemoEntries = strtoull(optarg, nullptr, 10); break;
+            case 'l': options.m_Library = true; break;
+            case 'w': options.m_Processes = max(0, atoi(optarg)); break;
+            case 'r': options.m_Store = optarg; break;
+            case 's': options.m_Seed = strtoull(optarg, nullptr, 10); break;
+            default:
+                cerr << "usage: " << argv[0] << " [-c companies] [-p packs] [-t maxThreads] [-x executorThreads] [-f] [-m memoEntries] [-l]"
+                     << " [-w processes] [-r store] [-s seed]" << endl;
+                return 1;
+        }
+    }
+
+    if(!options.m_Store.empty()) remove(options.m_Store.c_str());
+
+    vector<size_t> threadCounts;
+    for(size_t t = 1; t < options.m_MaxThreads; t *= 2) threadCounts.push_back(t);
+    threadCounts.push_back(options.m_MaxThreads);
+
+    cout << options.m_Companies << " companies x " << options.m_Packs << " packs" << endl;
+    double single = 0;
+    bool ok = true;
+    for(auto threads : threadCounts){
+        double elapsed = runIsolated(options, threads);
+        if(elapsed < 0){
+            cout << setw(4) << threads << " threads  FAILED" << endl;
+            ok = false;
+            continue;
+        }
+        if(threads == 1) single = elapsed;
+        cout << setw(4) << threads << " threads " << fixed << setprecision(3) << setw(12) << elapsed << " ms";
+        if(single) cout << "  speedup " << setprecision(2) << single / elapsed;
+        cout << endl;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trace_company.h"
+
+static constexpr char                  TRACE_MAGIC[4]                          = { 'P', 'K', 'T', 'R' };
+//=============================================================================================================================================================
+                                       CRecordingCompany::CRecordingCompany    ( ACompany                              company,
+                                                                                 const std::string                   & fileName )
+  : m_Company ( std::move ( company ) ),
+    m_Fp ( fopen ( fileName . c_str (), "wb" ) )
+{
+  if ( ! m_Fp )
+    throw std::runtime_error ( "CRecordingCompany: cannot create " + fileName );
+  write ( TRACE_MAGIC, sizeof ( TRACE_MAGIC ), 1 );
+  write ( &TRACE_VERSION, sizeof ( TRACE_VERSION ), 1 );
+  if ( m_Failed )
+  {
+    // the destructor does not run for a throwing constructor
+    fclose ( m_Fp );
+    throw std::runtime_error ( "CRecordingCompany: cannot write " + fileName );
+  }
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+                                       CRecordingCompany::~CRecordingCompany   () noexcept
+{
+  fclose ( m_Fp );
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+AProblemPack                           CRecordingCompany::waitForPack          ()
+{
+  AProblemPack pack = m_Company -> waitForPack ();
+
+  auto now = std::chrono::steady_clock::now ();
+  if ( ! m_Started )
+  {
+    m_Started = true;
+    m_Start = now;
+  }
+  uint64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds> ( now - m_Start ) . count ();
+  uint32_t counts[2] = { END_OF_STREAM, END_OF_STREAM };
+  if ( pack )
+  {
+    counts[0] = pack -> m_ProblemsMin . size ();
+    counts[1] = pack -> m_ProblemsCnt . size ();
+  }
+
+  write ( &timestamp, sizeof ( timestamp ), 1 );
+  write ( counts, sizeof ( counts ), 1 );
+  if ( pack )
+  {
+    writePolygons ( pack -> m_ProblemsMin );
+    writePolygons ( pack -> m_ProblemsCnt );
+  }
+  else if ( ! m_Failed && fflush ( m_Fp ) )
+    m_Failed = true;
+  return pack;
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+void                                   CRecordingCompany::solvedPack           ( AProblemPack                          pack )
+{
+  m_Company -> solvedPack ( std::move ( pack ) );
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool                                   CRecordingCompany::failed               () const
+{
+  return m_Failed;
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+void                                   CRecordingCompany::write                ( const void                          * data,
+                                                                                 size_t                                size,
+                                                                                 size_t                                count )
+{
+  // nothing is written after a failure, the trace would continue past a lost record
+  if ( ! m_Failed && fwrite ( data, size, count, m_Fp ) != count )
+    m_Failed = true;
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+void                                   CRecordingCompany::writePolygons        ( const std::vector<APolygon>         & polygons )
+{
+  static_assert ( sizeof ( CPoint ) == 2 * sizeof ( int32_t ), "CPoint is expected to be a pair of 32 bit integers" );
+  for ( const auto & p : polygons )
+  {
+    uint32_t n = p -> m_Points . size ();
+    write ( &n, sizeof ( n ), 1 );
+    write ( p -> m_Points . data (), sizeof ( CPoint ), n );
+  }
+}
+//=============================================================================================================================================================
+                                       CReplayCompany::CReplayCompany          ( const std::string                   & fileName,
+                                                                                 double                                speed )
+  : m_Speed ( speed )
+{
+  int fd = open ( fileName . c_str (), O_RDONLY );
+  if ( fd < 0 )
+    throw std::runtime_error ( "CReplayCompany: cannot open " + fileName );
+
+  struct stat st;
+  if ( fstat ( fd, &st ) == 0 && st . st_size > 0 )
+  {
+    void * data = mmap ( nullptr, st . st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( data != MAP_FAILED )
+    {
+      m_Data = static_cast<const uint8_t *> ( data );
+      m_Size = st . st_size;
+      madvise ( data, m_Size, MADV_SEQUENTIAL );
+    }
+  }
+  close ( fd );
+
+  uint32_t version = 0;
+  if ( m_Data
+       && m_Size >= sizeof ( TRACE_MAGIC ) + sizeof ( version )
+       && ! memcmp ( read ( sizeof ( TRACE_MAGIC ) ), TRACE_MAGIC, sizeof ( TRACE_MAGIC ) ) )
+    memcpy ( &version, read ( sizeof ( version ) ), sizeof ( version ) );
+
+  if ( version != CRecordingCompany::TRACE_VERSION )
+  {
+    // the destructor does not run for a throwing constructor
+    if ( m_Data )
+      munmap ( const_cast<uint8_t *> ( m_Data ), m_Size );
+    throw std::runtime_error ( "CReplayCompany: invalid trace " + fileName );
+  }
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+                                       CReplayCompany::~CReplayCompany         () noexcept
+{
+  if ( m_Data )
+    munmap ( const_cast<uint8_t *> ( m_Data ), m_Size );
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+const uint8_t                        * CReplayCompany::read                    ( size_t                                len )
+{
+  if ( len > m_Size - m_Pos )
+    return nullptr;
+  const uint8_t * res = m_Data + m_Pos;
+  m_Pos += len;
+  return res;
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+APolygon                               CReplayCompany::readPolygon             ()
+{
+  uint32_t n;
+  const uint8_t * count = read ( sizeof ( n ) );
+  if ( ! count )
+    return APolygon ();
+  memcpy ( &n, count, sizeof ( n ) );
+  const uint8_t * coords = read ( size_t ( n ) * sizeof ( CPoint ) );
+  if ( ! coords )
+    return APolygon ();
+
+  std::vector<CPoint> points;
+  points . reserve ( n );
+  for ( uint32_t i = 0; i < n; i ++ )
+  {
+    int32_t xy[2];
+    memcpy ( xy, coords + i * sizeof ( xy ), sizeof ( xy ) );
+    points . emplace_back ( xy[0], xy[1] );
+  }
+  return std::make_shared<CPolygon> ( std::move ( points ) );
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+AProblemPack                           CReplayCompany::waitForPack             ()
+{
+  if ( m_Finished )
+    throw std::invalid_argument ( "waitForPack: called too many times" );
+
+  // a truncated record ends the stream, throwing would kill the receiver thread of the optimizer
+  uint64_t timestamp;
+  uint32_t counts[2] = { CRecordingCompany::END_OF_STREAM, CRecordingCompany::END_OF_STREAM };
+  const uint8_t * header = read ( sizeof ( timestamp ) + sizeof ( counts ) );
+  if ( ! header )
+    return endOfStream ( true );
+  memcpy ( &timestamp, header, sizeof ( timestamp ) );
+  memcpy ( counts, header + sizeof ( timestamp ), sizeof ( counts ) );
+
+  auto now = std::chrono::steady_clock::now ();
+  if ( ! m_Started )
+  {
+    m_Started = true;
+    m_Start = now;
+  }
+  if ( m_Speed > 0 )
+    std::this_thread::sleep_until ( m_Start + std::chrono::nanoseconds ( uint64_t ( timestamp / m_Speed ) ) );
+
+  if ( counts[0] == CRecordingCompany::END_OF_STREAM )
+    return endOfStream ( false );
+
+  AProblemPack res = std::make_shared<CProblemPack> ();
+  for ( uint32_t i = 0; i < counts[0] + counts[1]; i ++ )
+  {
+    APolygon p = readPolygon ();
+    if ( ! p )
+      return endOfStream ( true );
+    if ( i < counts[0] )
+      res -> addMin ( std::move ( p ) );
+    else
+      res -> addCnt ( std::move ( p ) );
+  }
+
+  std::lock_guard<std::mutex> lock ( m_Mtx );
+  m_Delivered . push_back ( res );
+  return res;
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+AProblemPack                           CReplayCompany::endOfStream             ( bool                                  truncated )
+{
+  std::lock_guard<std::mutex> lock ( m_Mtx );
+  m_Finished = true;
+  m_Truncated = truncated;
+  return AProblemPack ();
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+void                                   CReplayCompany::solvedPack              ( AProblemPack                          pack )
+{
+  std::lock_guard<std::mutex> lock ( m_Mtx );
+  if ( m_Delivered . empty () || m_Delivered . front () != pack )
+    throw std::invalid_argument ( "solvedPack: order not preserved" );
+  m_Delivered . pop_front ();
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool                                   CReplayCompany::allProcessed            () const
+{
+  std::lock_guard<std::mutex> lock ( m_Mtx );
+  return m_Finished && m_Delivered . empty ();
+}
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+bool                                   CReplayCompany::truncated               () const
+{
+  std::lock_guard<std::mutex> lock ( m_Mtx );
+  return m_Truncated;
+}
+//=============================================================================================================================================================
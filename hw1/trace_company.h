@@ -0,0 +1,116 @@
+// The classes in this header record the pack stream of a live company into a binary trace and
+// replay the trace later. They are meant for offline benchmarking of the optimizer, the classes
+// do not exist in the Progtest's testing environment.
+//
+// Trace layout (native byte order):
+//   header:   char magic[4] = "PKTR", uint32_t version
+//   record:   uint64_t timestamp (ns since the first waitForPack call), uint32_t nMin, uint32_t nCnt,
+//             followed by nMin + nCnt polygons: uint32_t nPoints, int32_t x0, y0, x1, y1, ...
+//   the stream ends with a record with nMin = nCnt = END_OF_STREAM (no polygons follow)
+#ifndef TRACE_COMPANY_H_7351902846512093
+#define TRACE_COMPANY_H_7351902846512093
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include "common.h"
+
+//=============================================================================================================================================================
+/**
+ * A decorator which forwards all calls to the wrapped company and appends every pack returned by
+ * waitForPack to a trace file. A failed write does not disturb the company, the recording stops
+ * and failed() reports the trace as incomplete.
+ */
+class CRecordingCompany : public CCompany
+{
+  public:
+    static constexpr uint32_t          TRACE_VERSION                           = 1;
+    static constexpr uint32_t          END_OF_STREAM                           = 0xffffffff;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    /**
+     * @param[in] company     the company to record
+     * @param[in] fileName    the trace to create (truncated if it exists)
+     * @exception std::runtime_error if the trace cannot be created or its header cannot be written
+     */
+                                       CRecordingCompany                       ( ACompany                              company,
+                                                                                 const std::string                   & fileName );
+                                       ~CRecordingCompany                      () noexcept override;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    AProblemPack                       waitForPack                             () override;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    void                               solvedPack                              ( AProblemPack                          pack ) override;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    /**
+     * @return true if a write to the trace failed, the trace then ends before the end of the stream
+     */
+    bool                               failed                                  () const;
+  private:
+    void                               write                                   ( const void                          * data,
+                                                                                 size_t                                size,
+                                                                                 size_t                                count );
+    void                               writePolygons                           ( const std::vector<APolygon>         & polygons );
+    ACompany                           m_Company;
+    FILE                             * m_Fp;
+    bool                               m_Started  { false };
+    bool                               m_Failed   { false };
+    std::chrono::steady_clock::time_point m_Start;
+};
+//=============================================================================================================================================================
+/**
+ * A company which memory-maps a trace created by CRecordingCompany and delivers the recorded packs.
+ * The packs are delivered at the recorded times divided by the speed-up factor, speed 0 delivers
+ * the packs as fast as possible. The returned packs are checked for order. A truncated trace ends
+ * the stream after the last complete pack, truncated() reports it.
+ */
+class CReplayCompany : public CCompany
+{
+  public:
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    /**
+     * @param[in] fileName    the trace to replay
+     * @param[in] speed       speed-up factor, 1 = original timing, 0 = no delays
+     * @exception std::runtime_error if the trace cannot be mapped or has an invalid header
+     */
+                                       CReplayCompany                          ( const std::string                   & fileName,
+                                                                                 double                                speed = 1 );
+                                       ~CReplayCompany                         () noexcept override;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    /**
+     * @return the next recorded pack, or an empty smart pointer at the end of the trace or where it is truncated
+     */
+    AProblemPack                       waitForPack                             () override;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    /**
+     * @param[in] pack        a pack to return
+     * @exception std::invalid_argument if the packs are not returned in the delivery order
+     */
+    void                               solvedPack                              ( AProblemPack                          pack ) override;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    /**
+     * @return true if the whole trace was delivered and all packs were returned
+     */
+    bool                               allProcessed                            () const;
+    //---------------------------------------------------------------------------------------------------------------------------------------------------------
+    /**
+     * @return true if the stream ended at a truncated record instead of the end of stream record
+     */
+    bool                               truncated                               () const;
+  private:
+    const uint8_t                    * read                                    ( size_t                                len );
+    APolygon                           readPolygon                             ();
+    AProblemPack                       endOfStream                             ( bool                                  truncated );
+    const uint8_t                    * m_Data   { nullptr };
+    size_t                             m_Size   { 0 };
+    size_t                             m_Pos    { 0 };
+    double                             m_Speed;
+    bool                               m_Started  { false };
+    bool                               m_Finished { false };
+    bool                               m_Truncated { false };
+    std::chrono::steady_clock::time_point m_Start;
+    mutable std::mutex                 m_Mtx;
+    std::deque<AProblemPack>           m_Delivered;
+};
+using AReplayCompany = std::shared_ptr<CReplayCompany>;
+//=============================================================================================================================================================
+#endif /* TRACE_COMPANY_H_7351902846512093 */
@@ -0,0 +1,140 @@
+// Round trip test of the trace companies (trace_company.h). A generated pack stream is recorded by CRecordingCompany
+// and replayed by CReplayCompany, the replayed packs must equal the recorded ones. Every truncated copy of the trace
+// must replay a prefix of the packs and end the stream without throwing, a recording to /dev/full must fail.
+//   ./trace_test [trace]   (see the trace target in the Makefile, the trace and its copy are removed afterwards)
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include "trace_company.h"
+
+using namespace std;
+
+static constexpr size_t PACKS = 40;     // every cut of the trace is replayed, the test is quadratic in its size
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+// Delivers random packs, keeps them to compare with the replay
+class CGeneratedCompany : public CCompany
+{
+public:
+    CGeneratedCompany(size_t packs, uint64_t seed) : m_Left(packs), m_Rng(seed) {}
+
+    AProblemPack waitForPack() override
+    {
+        if(!m_Left) return AProblemPack();
+        m_Left--;
+        auto pack = make_shared<CProblemPack>();
+        for(size_t i = m_Rng() % 4; i > 0; --i) pack->addMin(polygon());
+        for(size_t i = m_Rng() % 4; i > 0; --i) pack->addCnt(polygon());
+        m_Packs.push_back(pack);
+        return pack;
+    }
+
+    void solvedPack(AProblemPack) override {}
+
+    vector<AProblemPack> m_Packs;
+
+private:
+    APolygon polygon()
+    {
+        vector<CPoint> points;
+        for(size_t i = m_Rng() % 20; i > 0; --i)
+            points.emplace_back(int(m_Rng() % 2001) - 1000, int(m_Rng() % 2001) - 1000);
+        return make_shared<CPolygon>(std::move(points));
+    }
+
+    size_t m_Left;
+    mt19937_64 m_Rng;
+};
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+static bool samePolygons(const vector<APolygon> & a, const vector<APolygon> & b)
+{
+    if(a.size() != b.size()) return false;
+    for(size_t i = 0; i < a.size(); ++i)
+        if(a[i]->m_Points != b[i]->m_Points) return false;
+    return true;
+}
+
+
+// Replays the whole trace, returns the number of the packs equal to the expected ones before the end of the stream
+static size_t replay(const string & fileName, const vector<AProblemPack> & expected, bool & truncated)
+{
+    CReplayCompany company(fileName, 0);
+    size_t packs = 0;
+    while(AProblemPack pack = company.waitForPack()){
+        assert(packs < expected.size());
+        assert(samePolygons(pack->m_ProblemsMin, expected[packs]->m_ProblemsMin));
+        assert(samePolygons(pack->m_ProblemsCnt, expected[packs]->m_ProblemsCnt));
+        company.solvedPack(pack);
+        packs++;
+    }
+    assert(company.allProcessed());
+    truncated = company.truncated();
+    return packs;
+}
+
+
+static vector<char> readFile(const string & fileName)
+{
+    vector<char> data;
+    FILE * fp = fopen(fileName.c_str(), "rb");
+    assert(fp);
+    char buffer[4096];
+    for(size_t n; (n = fread(buffer, 1, sizeof(buffer), fp)) > 0; ) data.insert(data.end(), buffer, buffer + n);
+    fclose(fp);
+    return data;
+}
+
+
+static void writeFile(const string & fileName, const vector<char> & data, size_t len)
+{
+    FILE * fp = fopen(fileName.c_str(), "wb");
+    assert(fp);
+    size_t written = fwrite(data.data(), 1, len, fp);
+    assert(written == len);
+    fclose(fp);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char * argv[])
+{
+    string fileName = argc > 1 ? argv[1] : "trace_test.trace";
+    string copyName = fileName + ".part";
+
+    auto generated = make_shared<CGeneratedCompany>(PACKS, 1);
+    {
+        CRecordingCompany recording(generated, fileName);
+        while(AProblemPack pack = recording.waitForPack()) recording.solvedPack(pack);
+        assert(!recording.failed());
+    }
+
+    bool truncated;
+    assert(replay(fileName, generated->m_Packs, truncated) == generated->m_Packs.size() && !truncated);
+
+    // every cut past the header ends the stream, only the end of stream record may be missing after the last pack
+    auto data = readFile(fileName);
+    size_t headerLen = 8;   // magic and version
+    size_t previous = 0;
+    for(size_t len = headerLen; len < data.size(); ++len){
+        writeFile(copyName, data, len);
+        size_t packs = replay(copyName, generated->m_Packs, truncated);
+        assert(truncated && packs >= previous && packs <= generated->m_Packs.size());
+        previous = packs;
+    }
+
+    // /dev/full accepts the buffered header, the end of the stream flushes the buffer and fails
+    {
+        CRecordingCompany recording(make_shared<CGeneratedCompany>(PACKS, 2), "/dev/full");
+        while(AProblemPack pack = recording.waitForPack()) recording.solvedPack(pack);
+        assert(recording.failed());
+    }
+
+    remove(fileName.c_str());
+    remove(copyName.c_str());
+    cout << "trace round trip ok, " << generated->m_Packs.size() << " packs, " << data.size() - headerLen << " cuts" << endl;
+    return 0;
+}
@@ -29,6 +29,32 @@ struct TBlkDev
 
 
 constexpr int                       INIT_TIMESTAMP                          = 1;
+constexpr int                       BATCH_STRIPES                           = 32;   // stripes staged per batched device I/O
+constexpr int                       MAX_READ_GAP                            = 1;    // unneeded rows read to join two runs
+constexpr int                       MAX_CACHE_STRIPES                       = 256;
+
+// A block of rows on the heap, copied by value
+struct CRowBlock
+{
+    explicit CRowBlock(int rows = 0) : m_Rows(rows), m_Data(rows ? new unsigned char[rows * SECTOR_SIZE] : nullptr) {}
+    CRowBlock(const CRowBlock & other) : CRowBlock(other.m_Rows) { copyData(other); }
+    ~CRowBlock() { delete [] m_Data; }
+
+    CRowBlock & operator = (const CRowBlock & other)
+    {
+        if(this == &other) return *this;
+        delete [] m_Data;
+        m_Rows = other.m_Rows;
+        m_Data = m_Rows ? new unsigned char[m_Rows * SECTOR_SIZE] : nullptr;
+        copyData(other);
+        return *this;
+    }
+
+    void copyData(const CRowBlock & other) { if(m_Rows) memcpy(m_Data, other.m_Data, m_Rows * SECTOR_SIZE); }
+
+    int m_Rows;
+    unsigned char * m_Data;
+};
 
 class CRaidVolume
 {
@@ -45,6 +71,9 @@ public:
     int                                status             () const;
     int                                size               () const;
 
+    void                               useStripeCache     ( int stripes );
+    bool                               flush              ();
+
 private:
     void                               findDiskAndStripe  (int secNr, int & diskForData, int & diskForParity,
                                                            int & stripe) const;
@@ -54,6 +83,19 @@ private:
     bool                               readData         (int & sector, char * & data, int secEnd);
     bool                               writeData  (int & sector, const char * & data, int secEnd);
 
+    void                               beginBatch         (int stripe);
+    unsigned char                    * row                (int disk, int stripe) const;
+    void                               markOtherRows      (int disk, int stripe);
+    void                               reconstruct        (int disk, int stripe, void * data) const;
+    bool                               readRows           ();
+    bool                               writeRows          ();
+
+    bool                               writeCached        (int & sector, const char * & data, int secEnd);
+    int                                cacheFind          (int stripe);
+    int                                cacheLoad          (int stripe);
+    bool                               cacheWriteBack     (int entry);
+    unsigned char                    * cacheRow           (int entry, int disk) const;
+
     void                               buffersClear       ();
 
     static int                         writeTimeStamp     (const TBlkDev & dev, int m_Time, int failedDevice = -1);
@@ -62,10 +104,27 @@ private:
 
     int                               m_Status;
     int                               m_Time;
-    TBlkDev                           m_Dev;
+    TBlkDev                           m_Dev = {};
     int                               m_FailedDev;
-    unsigned char                     m_Buffer[SECTOR_SIZE];
-    unsigned char                     m_OldData[SECTOR_SIZE];
+    unsigned char                     m_Buffer[SECTOR_SIZE] = {};
+    unsigned char                     m_OldData[SECTOR_SIZE] = {};
+
+    // The rows (sectors of one stripe) of each device for BATCH_STRIPES stripes from m_BatchStripe. The marked rows
+    // are transferred by one device call per run of consecutive rows.
+    CRowBlock                         m_Rows{MAX_RAID_DEVICES * BATCH_STRIPES};
+    int                               m_BatchStripe = 0;
+    bool                              m_ReadRow[MAX_RAID_DEVICES][BATCH_STRIPES] = {};
+    bool                              m_DirtyRow[MAX_RAID_DEVICES][BATCH_STRIPES] = {};
+
+    // Write-back cache of whole stripes, the rows of all devices (the failed one reconstructed) of m_CacheSize stripes.
+    // The devices hold the stale rows of the dirty entries until written back, the least recently used entry is evicted.
+    int                               m_CacheSize = 0;
+    int                               m_CacheUsed = 0;
+    unsigned                          m_CacheClock = 0;
+    CRowBlock                         m_CacheRows;
+    int                               m_CacheStripe[MAX_CACHE_STRIPES] = {};
+    unsigned                          m_CacheUse[MAX_CACHE_STRIPES] = {};
+    bool                              m_CacheDirty[MAX_CACHE_STRIPES][MAX_RAID_DEVICES] = {};
 };
 
 bool CRaidVolume::read ( int secNr, void * dataVoid, int secCnt )
@@ -97,11 +156,11 @@ bool CRaidVolume::write ( int secNr, const void * dataVoid, int secCnt )
     switch (m_Status)
     {
         case RAID_OK:
-            if (writeData(secNr, data, endSec))
+            if (m_CacheSize ? writeCached(secNr, data, endSec) : writeData(secNr, data, endSec))
                 return true;
 
         case RAID_DEGRADED:
-            if(writeData(secNr, data, endSec))
+            if(m_CacheSize ? writeCached(secNr, data, endSec) : writeData(secNr, data, endSec))
                 return true;
 
         default:
@@ -110,107 +169,355 @@ bool CRaidVolume::write ( int secNr, const void * dataVoid, int secCnt )
 }
 
 
+// Works in batches of BATCH_STRIPES stripes, on a failure sector and data point to the first sector of the failed batch
 bool CRaidVolume::readData(int & sector, char * & data, int secEnd)
 {
-    int diskForData, diskForParity, stripe;
+    int diskForData = 0, diskForParity = 0, stripe = 0;
+    int dataDisks = m_Dev.m_Devices - 1;
 
-    for(; sector < secEnd; sector++)
+    while(sector < secEnd)
     {
-        findDiskAndStripe(sector, diskForData, diskForParity, stripe);
-        buffersClear();
+        beginBatch(sector / dataDisks);
+        int batchEnd = min(secEnd, (m_BatchStripe + BATCH_STRIPES) * dataDisks);
 
-        // Reading from the failed device, using XORed data from other devices
-        if(diskForData == m_FailedDev)
+        // The sector of the failed device is the XOR of its stripe on the other devices, the cached stripes are not read
+        for(int i = sector; i < batchEnd; i++)
         {
-            unsigned char xorBuffer[SECTOR_SIZE] = {0};
+            findDiskAndStripe(i, diskForData, diskForParity, stripe);
+            if(m_CacheSize && cacheFind(stripe) >= 0) continue;
 
-            for(int i = 0; i < m_Dev.m_Devices; i++)
-            {
-                if(i == m_FailedDev) continue;
+            if(diskForData == m_FailedDev) markOtherRows(diskForData, stripe);
+            else m_ReadRow[diskForData][stripe - m_BatchStripe] = true;
+        }
 
-                if(!readAndUpdate(i, stripe, m_Buffer, 1))
-                    return false;
+        if(!readRows())
+            return false;
 
-                for(int j = 0; j < SECTOR_SIZE; j++)
-                    xorBuffer[j] ^= m_Buffer[j];
-            }
+        for(; sector < batchEnd; sector++, data += SECTOR_SIZE)
+        {
+            findDiskAndStripe(sector, diskForData, diskForParity, stripe);
+            int entry = m_CacheSize ? cacheFind(stripe) : -1;
 
-            memcpy(data, xorBuffer, SECTOR_SIZE);
+            if(entry >= 0) memcpy(data, cacheRow(entry, diskForData), SECTOR_SIZE);
+            else if(diskForData == m_FailedDev) reconstruct(diskForData, stripe, data);
+            else memcpy(data, row(diskForData, stripe), SECTOR_SIZE);
         }
-        else
-            if(!readAndUpdate(diskForData, stripe, data, 1))
-                return false;
-
-        data += SECTOR_SIZE;
     }
     return true;
 }
 
 
+// Every stripe of a batch gets one new parity. Read-modify-write reads the touched data rows and the parity and applies
+// the delta of the old and the new data, reconstruct-write reads the untouched data rows and XORs the whole stripe.
+// The one reading fewer rows is used, a stripe written whole needs no reads. Nothing is written until the whole batch
+// is read, a batch failing while read is retried by write() in the degraded mode.
 bool CRaidVolume::writeData(int & sector, const char * & data, int secEnd)
 {
-    int diskForData, diskForParity, stripe;
+    int diskForData = 0, diskForParity = 0, stripe = 0;
+    int dataDisks = m_Dev.m_Devices - 1;
+    bool reconstructWrite[BATCH_STRIPES];
 
-    for(; sector < secEnd; sector++)
+    while(sector < secEnd)
     {
-        findDiskAndStripe(sector, diskForData, diskForParity, stripe);
-        buffersClear();
+        beginBatch(sector / dataDisks);
+        int batchEnd = min(secEnd, (m_BatchStripe + BATCH_STRIPES) * dataDisks);
+        int endStripe = (batchEnd - 1) / dataDisks + 1;
 
-        // Read the data from not failed disk
-        if(diskForData != m_FailedDev)
+        for(stripe = m_BatchStripe; stripe < endStripe; stripe++)
         {
-            // Reads the old data, writes the new
-            if(!readAndUpdate(diskForData, stripe, m_OldData, 1) || !writeAndUpdate(diskForData, stripe, data, 1))
-                return false;
+            int first = max(sector, stripe * dataDisks), last = min(batchEnd, (stripe + 1) * dataDisks);
+            int touched = last - first;
 
-            // If the disk for parity is failed we won't write it, it can be synced from the other disks
-            if(m_FailedDev == diskForParity)
+            // The old data of a failed device is lost, it must be touched for read-modify-write and untouched
+            // for reconstruct-write
+            bool failedTouched = false, failedUntouched = false;
+            for(int i = stripe * dataDisks; i < (stripe + 1) * dataDisks; i++)
             {
-                data += SECTOR_SIZE;
-                continue;
+                findDiskAndStripe(i, diskForData, diskForParity, stripe);
+                if(diskForData != m_FailedDev) continue;
+
+                if(i >= first && i < last) failedTouched = true;
+                else failedUntouched = true;
             }
 
-            // Read the parity, un xor the old data, add the new
-            if(!readAndUpdate(diskForParity, stripe, m_Buffer, 1))
-                return false;
+            bool reconstruct = failedTouched || (!failedUntouched && dataDisks - touched < touched + 1);
+            reconstructWrite[stripe - m_BatchStripe] = reconstruct;
 
-            for(int j = 0; j < SECTOR_SIZE; j++)
-                m_Buffer[j] = m_Buffer[j] ^ m_OldData[j] ^ data[j];
+            // a failed parity device is synced from the others later
+            if(diskForParity == m_FailedDev) continue;
+
+            for(int i = stripe * dataDisks; i < (stripe + 1) * dataDisks; i++)
+            {
+                findDiskAndStripe(i, diskForData, diskForParity, stripe);
+                if(reconstruct != (i >= first && i < last))
+                    m_ReadRow[diskForData][stripe - m_BatchStripe] = true;
+            }
+            if(!reconstruct)
+                m_ReadRow[diskForParity][stripe - m_BatchStripe] = true;
+        }
+
+        if(!readRows())
+            return false;
+
+        // The row of a failed device is staged too, reconstruct-write XORs it into the parity
+        for(; sector < batchEnd; sector++, data += SECTOR_SIZE)
+        {
+            findDiskAndStripe(sector, diskForData, diskForParity, stripe);
+            unsigned char * dataRow = row(diskForData, stripe);
+
+            if(diskForParity != m_FailedDev && !reconstructWrite[stripe - m_BatchStripe])
+            {
+                unsigned char * parity = row(diskForParity, stripe);
+                for(int j = 0; j < SECTOR_SIZE; j++)
+                    parity[j] ^= dataRow[j] ^ data[j];
+                m_DirtyRow[diskForParity][stripe - m_BatchStripe] = true;
+            }
+
+            memcpy(dataRow, data, SECTOR_SIZE);
+            if(diskForData != m_FailedDev)
+                m_DirtyRow[diskForData][stripe - m_BatchStripe] = true;
+        }
+
+        for(stripe = m_BatchStripe; stripe < endStripe; stripe++)
+        {
+            findDiskAndStripe(stripe * dataDisks, diskForData, diskForParity, stripe);
+            if(diskForParity == m_FailedDev || !reconstructWrite[stripe - m_BatchStripe]) continue;
 
-            if(!writeAndUpdate(diskForParity, stripe, m_Buffer, 1))
+            reconstruct(diskForParity, stripe, row(diskForParity, stripe));
+            m_DirtyRow[diskForParity][stripe - m_BatchStripe] = true;
+        }
+
+        if(!writeRows())
+            return false;
+    }
+    return true;
+}
+
+
+// Updates the cached stripes only. The runs of uncached stripes written whole bypass the cache, they need no reads
+// and would only evict the hot stripes.
+bool CRaidVolume::writeCached(int & sector, const char * & data, int secEnd)
+{
+    int diskForData = 0, diskForParity = 0, stripe = 0;
+    int dataDisks = m_Dev.m_Devices - 1;
+
+    while(sector < secEnd)
+    {
+        stripe = sector / dataDisks;
+        int stripeEnd = min(secEnd, (stripe + 1) * dataDisks);
+        bool whole = sector == stripe * dataDisks && stripeEnd == (stripe + 1) * dataDisks;
+
+        int entry = cacheFind(stripe);
+        if(whole && entry < 0)
+        {
+            int runEnd = stripeEnd;
+            while(runEnd + dataDisks <= secEnd && cacheFind(runEnd / dataDisks) < 0)
+                runEnd += dataDisks;
+
+            if(!writeData(sector, data, runEnd))
                 return false;
+            continue;
         }
-        else
+
+        if(entry < 0 && (entry = cacheLoad(stripe)) < 0)
+            return false;
+
+        for(; sector < stripeEnd; sector++, data += SECTOR_SIZE)
         {
-            // Retrieve the data using other disks
-            for(int i = 0; i < m_Dev.m_Devices; i++)
+            findDiskAndStripe(sector, diskForData, diskForParity, stripe);
+            unsigned char * dataRow = cacheRow(entry, diskForData);
+
+            if(!whole)
             {
-                if(i == m_FailedDev) continue;
+                unsigned char * parity = cacheRow(entry, diskForParity);
+                for(int j = 0; j < SECTOR_SIZE; j++)
+                    parity[j] ^= dataRow[j] ^ data[j];
+            }
+            memcpy(dataRow, data, SECTOR_SIZE);
+            m_CacheDirty[entry][diskForData] = true;
+        }
 
-                if(!readAndUpdate(i, stripe, m_Buffer, 1))
-                    return false;
+        if(whole)
+        {
+            unsigned char * parity = cacheRow(entry, diskForParity);
+            memset(parity, 0, SECTOR_SIZE);
+            for(int i = 0; i < m_Dev.m_Devices; i++)
+            {
+                if(i == diskForParity) continue;
 
+                const unsigned char * other = cacheRow(entry, i);
                 for(int j = 0; j < SECTOR_SIZE; j++)
-                    m_OldData[j] ^= m_Buffer[j];
+                    parity[j] ^= other[j];
             }
+        }
+        m_CacheDirty[entry][diskForParity] = true;
+    }
+    return true;
+}
+
+
+int CRaidVolume::cacheFind(int stripe)
+{
+    for(int i = 0; i < m_CacheUsed; i++)
+        if(m_CacheStripe[i] == stripe)
+        {
+            m_CacheUse[i] = ++m_CacheClock;
+            return i;
+        }
+    return -1;
+}
 
-            // Read the old parity
-            if(!readAndUpdate(diskForParity, stripe, m_Buffer, 1))
-                return false;
 
-            // Update parity with new Data
+// Returns the entry holding the stripe, -1 if the volume failed. The row of a device failing while loaded is
+// reconstructed from the others.
+int CRaidVolume::cacheLoad(int stripe)
+{
+    int entry = m_CacheUsed;
+    if(m_CacheUsed < m_CacheSize)
+        m_CacheUsed++;
+    else
+    {
+        entry = 0;
+        for(int i = 1; i < m_CacheUsed; i++)
+            if(m_CacheUse[i] < m_CacheUse[entry]) entry = i;
+
+        if(m_CacheStripe[entry] >= 0 && !cacheWriteBack(entry))
+            return -1;
+    }
+    m_CacheStripe[entry] = -1;
+    memset(m_CacheDirty[entry], 0, sizeof(m_CacheDirty[entry]));
+
+    for(int i = 0; i < m_Dev.m_Devices; i++)
+        if(i != m_FailedDev && !readAndUpdate(i, stripe, cacheRow(entry, i), 1) && m_Status == RAID_FAILED)
+            return -1;
+
+    if(m_FailedDev >= 0)
+    {
+        unsigned char * failed = cacheRow(entry, m_FailedDev);
+        memset(failed, 0, SECTOR_SIZE);
+        for(int i = 0; i < m_Dev.m_Devices; i++)
+        {
+            if(i == m_FailedDev) continue;
+
+            const unsigned char * other = cacheRow(entry, i);
             for(int j = 0; j < SECTOR_SIZE; j++)
-                m_Buffer[j] = m_Buffer[j] ^ m_OldData[j] ^ data[j];
+                failed[j] ^= other[j];
+        }
+    }
+
+    m_CacheStripe[entry] = stripe;
+    m_CacheUse[entry] = ++m_CacheClock;
+    return entry;
+}
+
+
+// Writes the dirty rows of the entry, false if the volume failed. The rows of a failed device stay in the entry only.
+bool CRaidVolume::cacheWriteBack(int entry)
+{
+    for(int i = 0; i < m_Dev.m_Devices; i++)
+    {
+        if(!m_CacheDirty[entry][i]) continue;
+
+        m_CacheDirty[entry][i] = false;
+        if(i != m_FailedDev && !writeAndUpdate(i, m_CacheStripe[entry], cacheRow(entry, i), 1) && m_Status == RAID_FAILED)
+            return false;
+    }
+    return true;
+}
+
+
+unsigned char * CRaidVolume::cacheRow(int entry, int disk) const
+{
+    return m_CacheRows.m_Data + (entry * MAX_RAID_DEVICES + disk) * SECTOR_SIZE;
+}
+
+
+void CRaidVolume::beginBatch(int stripe)
+{
+    m_BatchStripe = stripe;
+    memset(m_ReadRow, 0, sizeof(m_ReadRow));
+    memset(m_DirtyRow, 0, sizeof(m_DirtyRow));
+}
+
+
+unsigned char * CRaidVolume::row(int disk, int stripe) const
+{
+    return m_Rows.m_Data + (disk * BATCH_STRIPES + stripe - m_BatchStripe) * SECTOR_SIZE;
+}
+
+
+void CRaidVolume::markOtherRows(int disk, int stripe)
+{
+    for(int i = 0; i < m_Dev.m_Devices; i++)
+        if(i != disk) m_ReadRow[i][stripe - m_BatchStripe] = true;
+}
+
+
+// The rows of the stripe on the other devices must be staged
+void CRaidVolume::reconstruct(int disk, int stripe, void * data) const
+{
+    unsigned char * out = (unsigned char*)data;
+    memset(out, 0, SECTOR_SIZE);
+
+    for(int i = 0; i < m_Dev.m_Devices; i++)
+    {
+        if(i == disk) continue;
 
-            // Write the parity
-            if(!writeAndUpdate(diskForParity, stripe, m_Buffer, 1))
+        const unsigned char * other = row(i, stripe);
+        for(int j = 0; j < SECTOR_SIZE; j++)
+            out[j] ^= other[j];
+    }
+}
+
+
+bool CRaidVolume::readRows()
+{
+    for(int disk = 0; disk < m_Dev.m_Devices; disk++)
+        for(int first = 0; first < BATCH_STRIPES; first++)
+        {
+            if(!m_ReadRow[disk][first]) continue;
+
+            // the parity rotation leaves single row gaps in the data rows of a device
+            int last = first;
+            for(int next = first + 1; next < BATCH_STRIPES && next - last <= MAX_READ_GAP + 1; next++)
+                if(m_ReadRow[disk][next]) last = next;
+
+            if(!readAndUpdate(disk, m_BatchStripe + first, row(disk, m_BatchStripe + first), last - first + 1))
                 return false;
+            first = last;
+        }
+    return true;
+}
+
+
+// The staged rows are consistent, a device failing here holds the rows the others imply. Only the second failure
+// loses data.
+bool CRaidVolume::writeRows()
+{
+    for(int disk = 0; disk < m_Dev.m_Devices; disk++)
+    {
+        if(disk == m_FailedDev) continue;
+
+        for(int first = 0; first < BATCH_STRIPES; first++)
+        {
+            if(!m_DirtyRow[disk][first]) continue;
+
+            int last = first;
+            while(last + 1 < BATCH_STRIPES && m_DirtyRow[disk][last + 1]) last++;
+
+            if(!writeAndUpdate(disk, m_BatchStripe + first, row(disk, m_BatchStripe + first), last - first + 1))
+            {
+                if(m_Status == RAID_FAILED)
+                    return false;
+                break;
+            }
+            first = last;
         }
-        data += SECTOR_SIZE;
     }
     return true;
 }
 
+
 void CRaidVolume::findDiskAndStripe(int secNr, int & diskForData, int & diskForParity, int & stripe) const
 {
     stripe = secNr / (m_Dev.m_Devices - 1);
@@ -262,6 +569,7 @@ bool CRaidVolume::create ( const TBlkDev & dev )
 int CRaidVolume::start ( const TBlkDev & dev )
 {
     m_Dev = dev; m_FailedDev = -1; m_Status = RAID_OK;
+    m_CacheUsed = 0;
 
     int TimeStamps[MAX_RAID_DEVICES] = {0};
     buffersClear();
@@ -312,8 +620,14 @@ int CRaidVolume::start ( const TBlkDev & dev )
 }
 
 
+// A write-back failing here leaves the devices inconsistent, they keep the old timestamps and RAID_FAILED is returned.
+// Stopping the failed volume again writes the timestamps as for any other failed volume.
 int CRaidVolume::stop ()
 {
+    int status = m_Status;
+    if(!flush() && status != RAID_FAILED)
+        return m_Status;
+
     m_Time += 1;
     writeTimeStamp(m_Dev, m_Time, m_FailedDev);
 
@@ -326,6 +640,10 @@ int CRaidVolume::resync ()
     if(m_Status != RAID_DEGRADED)
         return m_Status;
 
+    // the stripes are rebuilt from the devices
+    if(!flush())
+        return m_Status;
+
     for(int i = 0; i < m_Dev.m_Sectors - 1; i++)
     {
         unsigned char xorBuffer[SECTOR_SIZE] = {0};
@@ -396,6 +714,53 @@ bool CRaidVolume::writeAndUpdate(int disk, int secNr, const void *data, int secC
 }
 
 
+/**
+ * Keeps up to stripes (at most MAX_CACHE_STRIPES) recently written stripes in memory and writes them back on eviction,
+ * flush or stop. Reads of the cached stripes are served from memory. 0 = off. Must be called before start.
+ */
+void CRaidVolume::useStripeCache ( int stripes )
+{
+    m_CacheSize = max(0, min(stripes, MAX_CACHE_STRIPES));
+    m_CacheRows = CRowBlock(m_CacheSize * MAX_RAID_DEVICES);
+    m_CacheUsed = 0;
+}
+
+
+// Writes back all dirty stripes, false if the volume failed. The cached stripes within BATCH_STRIPES of the lowest
+// one still dirty are staged together, thus the neighbouring stripes share the device calls.
+bool CRaidVolume::flush ()
+{
+    while(true)
+    {
+        int first = -1;
+        for(int i = 0; i < m_CacheUsed; i++)
+            for(int disk = 0; disk < m_Dev.m_Devices && m_CacheStripe[i] >= 0; disk++)
+                if(m_CacheDirty[i][disk] && (first < 0 || m_CacheStripe[i] < first))
+                    first = m_CacheStripe[i];
+        if(first < 0)
+            return m_Status != RAID_FAILED;
+
+        beginBatch(first);
+        for(int i = 0; i < m_CacheUsed; i++)
+        {
+            int stripe = m_CacheStripe[i];
+            if(stripe < first || stripe >= first + BATCH_STRIPES) continue;
+
+            for(int disk = 0; disk < m_Dev.m_Devices; disk++)
+                if(m_CacheDirty[i][disk])
+                {
+                    m_CacheDirty[i][disk] = false;
+                    memcpy(row(disk, stripe), cacheRow(i, disk), SECTOR_SIZE);
+                    m_DirtyRow[disk][stripe - first] = true;
+                }
+        }
+
+        if(!writeRows())
+            return false;
+    }
+}
+
+
 int CRaidVolume::status () const
 {
     return m_Status;
@@ -109,6 +109,21 @@ int diskWriteBadAllRand(int device, int sectorNr, const void *data,
   return diskWrite(device, sectorNr, data, sectorCnt);
 }
 
+//-------------------------------------------------------------------------------------------------
+/** Sector reading/writing functions counting the device calls
+ */
+int g_Reads = 0, g_Writes = 0;
+
+int diskReadCount(int device, int sectorNr, void *data, int sectorCnt) {
+  g_Reads++;
+  return diskRead(device, sectorNr, data, sectorCnt);
+}
+
+int diskWriteCount(int device, int sectorNr, const void *data, int sectorCnt) {
+  g_Writes++;
+  return diskWrite(device, sectorNr, data, sectorCnt);
+}
+
 //-------------------------------------------------------------------------------------------------
 /** A function which releases resources allocated by openDisks/createDisks
  */
@@ -592,8 +607,205 @@ void test1() {
   doneDisks();
 }
 
+int readTimeStamp(int device) {
+  char buffer[SECTOR_SIZE];
+  int time = 0;
+  assert(diskRead(device, DISK_SECTORS - 1, buffer, 1) == 1);
+  memcpy(&time, buffer, sizeof(time));
+  return time;
+}
+
+void test2() {
+  CRaidVolume vol;
+  char buffer[SECTOR_SIZE * 3 * 32];
+  char check[sizeof(buffer)];
+  constexpr int DATA_DISKS = RAID_DEVICES - 1;
+
+  dbg("batched device calls!");
+
+  TBlkDev dev = createDisks();
+  dev.m_Read = diskReadCount;
+  dev.m_Write = diskWriteCount;
+  assert(CRaidVolume::create(dev));
+  assert(vol.start(dev) == RAID_OK);
+
+  // 32 whole stripes, one call per device and no reads
+  for (size_t i = 0; i < sizeof(buffer); i++)
+    buffer[i] = i % 251;
+  g_Reads = g_Writes = 0;
+  assert(vol.write(0, buffer, DATA_DISKS * 32));
+  assert(g_Reads == 0 && g_Writes == RAID_DEVICES);
+
+  // the parity rows between the data rows are read too
+  g_Reads = g_Writes = 0;
+  assert(vol.read(0, check, DATA_DISKS * 32));
+  assert(g_Reads == RAID_DEVICES && g_Writes == 0);
+  assert(!memcmp(buffer, check, sizeof(buffer)));
+
+  assert(vol.stop() == RAID_STOPPED);
+
+  // the rows of the failed device are reconstructed from the batch of the others
+  ONE_FAIL = 1;
+  dev.m_Read = diskReadBadOne;
+  assert(vol.start(dev) == RAID_DEGRADED);
+  assert(vol.read(0, check, DATA_DISKS * 32));
+  assert(!memcmp(buffer, check, sizeof(buffer)));
+
+  // the parity of a whole stripe covers the sector of the failed device too
+  for (size_t i = 0; i < sizeof(buffer); i++)
+    buffer[i] = i % 241;
+  g_Writes = 0;
+  assert(vol.write(0, buffer, DATA_DISKS * 32));
+  assert(g_Writes == RAID_DEVICES - 1);
+  assert(vol.read(0, check, DATA_DISKS * 32));
+  assert(!memcmp(buffer, check, sizeof(buffer)));
+  assert(vol.stop() == RAID_STOPPED);
+
+  doneDisks();
+
+  dbg("read-modify-write and reconstruct-write!");
+
+  dev = createDisks();
+  dev.m_Read = diskReadCount;
+  dev.m_Write = diskWriteCount;
+  assert(CRaidVolume::create(dev));
+  assert(vol.start(dev) == RAID_OK);
+
+  // one sector of a stripe: its data row and the parity are read
+  memset(buffer, 11, SECTOR_SIZE);
+  g_Reads = g_Writes = 0;
+  assert(vol.write(DATA_DISKS * 40, buffer, 1));
+  assert(g_Reads == 2 && g_Writes == 2);
+
+  // two sectors of a stripe: the third data row is read
+  memset(buffer, 22, 2 * SECTOR_SIZE);
+  g_Reads = g_Writes = 0;
+  assert(vol.write(DATA_DISKS * 41, buffer, 2));
+  assert(g_Reads == 1 && g_Writes == 3);
+
+  assert(vol.stop() == RAID_STOPPED);
+
+  // the parity of both stripes reconstructs the data of any device
+  for (ONE_FAIL = 0; ONE_FAIL < RAID_DEVICES; ONE_FAIL++) {
+    dev.m_Read = diskReadBadOne;
+    assert(vol.start(dev) == RAID_DEGRADED);
+    assert(vol.read(DATA_DISKS * 40, check, DATA_DISKS * 2));
+    for (int i = 0; i < SECTOR_SIZE; i++)
+      assert(check[i] == 11 && check[DATA_DISKS * SECTOR_SIZE + i] == 22 &&
+             check[(DATA_DISKS + 1) * SECTOR_SIZE + i] == 22);
+    for (int i = SECTOR_SIZE; i < DATA_DISKS * SECTOR_SIZE; i++)
+      assert(check[i] == 0);
+    assert(vol.stop() == RAID_STOPPED);
+
+    // the failed read only degrades this run
+    dev.m_Read = diskReadCount;
+    assert(vol.start(dev) == RAID_DEGRADED);
+    assert(vol.resync() == RAID_OK);
+    assert(vol.stop() == RAID_STOPPED);
+  }
+
+  // degraded, the failed device decides: its own row is written by reconstruct-write, the others by
+  // read-modify-write (sector DATA_DISKS * 42 lies on device 0, the parity of stripe 42 on device 1)
+  ONE_FAIL = 0;
+  dev.m_Read = diskReadBadOne;
+  assert(vol.start(dev) == RAID_DEGRADED);
+  memset(buffer, 33, SECTOR_SIZE);
+  assert(vol.write(DATA_DISKS * 42, buffer, 1));
+  memset(buffer, 44, SECTOR_SIZE);
+  assert(vol.write(DATA_DISKS * 42 + 2, buffer, 1));
+  assert(vol.read(DATA_DISKS * 42, check, DATA_DISKS));
+  for (int i = 0; i < SECTOR_SIZE; i++)
+    assert(check[i] == 33 && check[SECTOR_SIZE + i] == 0 && check[2 * SECTOR_SIZE + i] == 44);
+  assert(vol.stop() == RAID_STOPPED);
+
+  doneDisks();
+
+  dbg("stripe cache write-back!");
+
+  dev = createDisks();
+  dev.m_Read = diskReadCount;
+  dev.m_Write = diskWriteCount;
+  assert(CRaidVolume::create(dev));
+
+  vol = CRaidVolume();
+  vol.useStripeCache(4);
+  assert(vol.start(dev) == RAID_OK);
+
+  // rewriting a cached stripe does not touch the devices
+  memset(buffer, 1, SECTOR_SIZE);
+  assert(vol.write(0, buffer, 1));
+  g_Reads = g_Writes = 0;
+  for (int i = 0; i < 100; i++)
+    assert(vol.write(0, buffer, 1));
+  assert(g_Reads == 0 && g_Writes == 0);
+  assert(vol.flush());
+  assert(g_Writes == 2);
+
+  // 10 stripes through 4 entries, the 6 least recently used are written back
+  for (int stripe = 0; stripe < 10; stripe++) {
+    memset(buffer, stripe + 1, SECTOR_SIZE);
+    assert(vol.write(stripe * DATA_DISKS, buffer, 1));
+  }
+
+  CRaidVolume direct;
+  assert(direct.start(dev) == RAID_OK);
+  for (int stripe = 0; stripe < 10; stripe++) {
+    assert(vol.read(stripe * DATA_DISKS, buffer, 1));
+    assert(buffer[0] == stripe + 1);
+    assert(direct.read(stripe * DATA_DISKS, buffer, 1));
+    assert(buffer[0] == (stripe < 6 ? stripe + 1 : 0));
+  }
+
+  assert(vol.flush());
+  for (int stripe = 6; stripe < 10; stripe++) {
+    assert(direct.read(stripe * DATA_DISKS, buffer, 1));
+    assert(buffer[0] == stripe + 1);
+  }
+
+  // stop writes the dirty stripes before the timestamps
+  memset(buffer, 99, SECTOR_SIZE);
+  assert(vol.write(DATA_DISKS * 20 + 1, buffer, 1));
+  assert(vol.stop() == RAID_STOPPED);
+
+  vol = CRaidVolume();
+  assert(vol.start(dev) == RAID_OK);
+  assert(vol.read(DATA_DISKS * 20 + 1, buffer, 1));
+  assert(buffer[0] == 99);
+  assert(vol.stop() == RAID_STOPPED);
+
+  doneDisks();
+
+  dbg("stripe cache write-back failing during stop!");
+
+  dev = createDisks();
+  TWO_FAIL[0] = TWO_FAIL[1] = -1;
+  dev.m_Write = diskWriteBadTwo;
+  assert(CRaidVolume::create(dev));
+
+  vol = CRaidVolume();
+  vol.useStripeCache(4);
+  assert(vol.start(dev) == RAID_OK);
+
+  memset(buffer, 7, 2 * SECTOR_SIZE);
+  assert(vol.write(0, buffer, 2));
+
+  // the write-back loses data, the timestamps stay old
+  TWO_FAIL[0] = 0;
+  TWO_FAIL[1] = 1;
+  assert(vol.stop() == RAID_FAILED);
+  assert(vol.status() == RAID_FAILED);
+  for (int i = 0; i < RAID_DEVICES; i++)
+    assert(readTimeStamp(i) == INIT_TIMESTAMP);
+
+  assert(vol.stop() == RAID_STOPPED);
+  assert(vol.status() == RAID_STOPPED);
+
+  doneDisks();
+}
+
 int main() {
   srand(time(nullptr));
   test1();
+  test2();
   return EXIT_SUCCESS;
 }